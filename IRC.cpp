@@ -23,13 +23,60 @@
 	IRC:	#magpie @ irc.quakenet.org
 */
 
+#include <thread>
+
+#ifndef _WIN64
+#include <poll.h>
+#endif
+
 #include "IRC.hpp"
+#include "IRC_bouncer.hpp"
+#include "IRC_ctcp.hpp"
+#include "IRC_dcc.hpp"
+#include "IRC_filter.hpp"
+#include "IRC_inbound.hpp"
+#include "IRC_log.hpp"
+#include "IRC_queue.hpp"
+#include "IRC_transport.hpp"
 
 namespace cpIRC
 {
+	// With an inbound queue, reads per process_input() before callbacks
+	// run, and lines dispatched between reads.
+	static const unsigned int inboundReads = 64;
+	static const unsigned int inboundBatch = 16;
+
+	// Whether a read would return straight away.
+	static bool readable(int fd)
+	{
+		if (fd < 0)
+			return false;
+
+#ifdef _WIN64
+		WSAPOLLFD p = { static_cast<SOCKET>(fd), POLLRDNORM, 0 };
+		return WSAPoll(&p, 1, 0) > 0;
+#else
+		pollfd p = { fd, POLLIN, 0 };
+		return poll(&p, 1, 0) > 0;
+#endif
+	}
+
 	IRC::IRC(void(*printFunction)(const char* fmt, ...))
 	{
 		callbackList = 0;
+		ctcpCallbackList = NULL;
+		ctcp = irc_new<IRCCtcp>();
+		filter = NULL;
+		recorder = NULL;
+		bouncer = NULL;
+		dcc = NULL;
+		transport = NULL;
+		ownsTransport = false;
+		recvPending = 0;
+		replaying = false;
+		sendQueue = irc_new<IRCSendQueue>(256u);
+		sendPolicy = IRC_SEND_BLOCK;
+		inbound = irc_new<IRCInboundQueue>();
 		connected = false;
 		prnt = printFunction;
 	}
@@ -40,71 +87,146 @@ namespace cpIRC
 			disconnect();
 
 		clear_callbacks();
+		irc_delete(ctcp);
+		irc_delete(sendQueue);
+		irc_delete(inbound);
 	}
 
 	int IRC::connect(const char* server, const short int port)
 	{
-		hostent* resolve;
-		sockaddr_in rem;
-
 		if (connected)
 			return IRC_ALREADY_CONNECTED;
 
-		ircSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-		if (ircSocket == INVALID_SOCKET)
-			return IRC_SOCKET_CREATION_FAILED;
-
-		resolve = gethostbyname(server);
-		if (!resolve)
-		{
-			closesocket(ircSocket);
-			return IRC_RESOLVE_FAILED;
-		}
-
-		memcpy(&rem.sin_addr, resolve->h_addr, 4);
-		rem.sin_family = AF_INET;
-		rem.sin_port = htons(port);
-
-		if (::connect(ircSocket, reinterpret_cast<const sockaddr*>(&rem), sizeof(rem)) == SOCKET_ERROR)
+		IRCSocketTransport* socket = irc_new<IRCSocketTransport>();
+		int result = socket->connect_tcp(server, port);
+		if (result != IRC_SUCCESS)
 		{
 #ifdef WIN32
-			if (prnt)
+			if (prnt && result == IRC_SOCKET_CONNECT_FAILED)
 				prnt("[cpIRC]: Failed to connect: %d\n", WSAGetLastError());
 #endif
-			closesocket(ircSocket);
-			return IRC_SOCKET_CONNECT_FAILED;
+			irc_delete(socket);
+			return result;
 		}
 
+		transport = socket;
+		ownsTransport = true;
+		recvPending = 0;
 		connected = true;
 		return IRC_SUCCESS;
 	}
 
-	void IRC::set_callback(const char* cmd, int(*function_ptr)(IRC*, IRCReply*))
+	int IRC::connect(IRCTransport* transport)
 	{
-		if (!callbackList)
-		{
-			callbackList = new CallbackHandler;
-			callbackList->next = NULL;
-			callbackList->callback = function_ptr;
+		if (connected)
+			return IRC_ALREADY_CONNECTED;
 
-			unsigned int cmd_length = strlen(cmd) + 1;
-			callbackList->command = new char[cmd_length]();
-			irc_strcpy(callbackList->command, cmd_length + 1, cmd);
+		this->transport = transport;
+		ownsTransport = false;
+		recvPending = 0;
+		connected = true;
+		return IRC_SUCCESS;
+	}
 
-			return;
+	void IRC::set_callback(const char* cmd, IRCCallback function)
+	{
+		add_callback(&callbackList, cmd, function);
+	}
+
+	void IRC::set_ctcp_callback(const char* ctcp, IRCCallback function)
+	{
+		add_callback(&ctcpCallbackList, ctcp, function);
+	}
+
+	void IRC::set_ctcp_limits(const unsigned int source_interval_ms, const unsigned int global_burst, const unsigned int global_interval_ms)
+	{
+		ctcp->set_limits(source_interval_ms, global_burst, global_interval_ms);
+	}
+
+	void IRC::set_ctcp_replies(const bool enabled)
+	{
+		ctcp->set_replies(enabled);
+	}
+
+	unsigned long long IRC::ctcp_dropped() const
+	{
+		return ctcp->dropped();
+	}
+
+	int IRC::set_send_capacity(const unsigned int lines)
+	{
+		if (connected)
+			return IRC_ALREADY_CONNECTED;
+
+		irc_delete(sendQueue);
+		sendQueue = irc_new<IRCSendQueue>(lines);
+		return IRC_SUCCESS;
+	}
+
+	void IRC::set_send_policy(IRCSendPolicy policy)
+	{
+		sendPolicy = policy;
+	}
+
+	int IRC::set_inbound_capacity(const unsigned int lines)
+	{
+		if (connected)
+			return IRC_ALREADY_CONNECTED;
+
+		inbound->set_capacity(lines);
+		return IRC_SUCCESS;
+	}
+
+	void IRC::set_inbound_policy(const char* command, const IRCInboundPolicy policy)
+	{
+		inbound->set_policy(command, policy);
+	}
+
+	void IRC::inbound_stats(IRCInboundStats* stats) const
+	{
+		inbound->stats(stats);
+	}
+
+	bool IRC::inbound_pending() const
+	{
+		return !inbound->empty();
+	}
+
+	unsigned int IRC::dispatch_inbound(const unsigned int max_lines)
+	{
+		char line[512];
+		unsigned int lines = 0;
+
+		while (lines < max_lines && inbound->pop(line, sizeof(line)))
+		{
+			parse_irc_reply(line);
+			++lines;
 		}
 
-		CallbackHandler* last = callbackList;
-		while (last->next)
-			last = last->next;
+		if (lines)
+			ctcp->flush(this);
+		return lines;
+	}
 
-		last->next = new CallbackHandler;
-		last->next->next = NULL;
-		last->next->callback = function_ptr;
+	void IRC::set_filter(IRCFilter* filter, IRCFilterCallback function)
+	{
+		this->filter = filter;
+		filterCallback = function;
+	}
 
-		unsigned int cmd_length = strlen(cmd) + 1;
-		last->next->command = new char[cmd_length]();
-		irc_strcpy(last->next->command, cmd_length + 1, cmd);
+	void IRC::set_recorder(IRCRecorder* recorder)
+	{
+		this->recorder = recorder;
+	}
+
+	void IRC::set_bouncer(IRCBouncer* bouncer)
+	{
+		this->bouncer = bouncer;
+	}
+
+	void IRC::set_dcc(IRCDcc* dcc)
+	{
+		this->dcc = dcc;
 	}
 
 	int IRC::message_loop()
@@ -112,30 +234,106 @@ namespace cpIRC
 		if (!connected)
 			return IRC_NOT_CONNECTED;
 
-		char* buffer = new char[1024]();
+		int result;
+		while ((result = process_input()) == IRC_SUCCESS)
+		{
+			// Work through the backlog while nothing new is waiting.
+			while (inbound_pending() && !readable(descriptor()))
+				dispatch_inbound(inboundBatch);
+		}
 
-		while (1)
+		return result == IRC_CONNECTION_CLOSED ? IRC_SUCCESS : result;
+	}
+
+	int IRC::process_input()
+	{
+		if (!connected)
+			return IRC_NOT_CONNECTED;
+
+		int result = read_input();
+
+		if (!inbound->enabled())
 		{
-			int ret_len = recv(ircSocket, buffer, 1023, 0);
+			if (result == IRC_SUCCESS)
+				ctcp->flush(this);
+			return result;
+		}
 
-			if (!ret_len) // Socked has been closed.
-				break;
+		// Empty the socket before any callbacks run, the queue takes up the slack.
+		for (unsigned int reads = 1; result == IRC_SUCCESS && reads < inboundReads && connected && readable(transport->descriptor()); ++reads)
+			result = read_input();
 
-			if (ret_len == SOCKET_ERROR)
-			{
+		if (result != IRC_SUCCESS)
+		{
+			// Nothing more is coming, let callbacks see the backlog.
+			while (dispatch_inbound(inboundBatch));
+			return result;
+		}
+
+		dispatch_inbound(inboundBatch);
+		return IRC_SUCCESS;
+	}
+
+	int IRC::read_input()
+	{
+		int ret_len = transport->recv(recvBuffer + recvPending, sizeof(recvBuffer) - 1 - recvPending);
+
+		if (!ret_len) // Socked has been closed.
+			return IRC_CONNECTION_CLOSED;
+
+		if (ret_len == SOCKET_ERROR)
+		{
 #ifdef WIN32
-				if (prnt)
-					prnt("[cpIRC]: Recv error: %d", WSAGetLastError());
+			if (prnt)
+				prnt("[cpIRC]: Recv error: %d", WSAGetLastError());
 #endif
-				delete[] buffer;
-				return IRC_RECV_FAILED;
-			}
+			return IRC_RECV_FAILED;
+		}
+
+		recvBuffer[recvPending + ret_len] = '\0';
+
+		// Keep a line split across reads for the next round.
+		char* rest = split_to_replies(recvBuffer);
+		recvPending = strlen(rest);
+		if (recvPending == sizeof(recvBuffer) - 1)
+			recvPending = 0; // No line is that long, drop it.
+		memmove(recvBuffer, rest, recvPending);
+
+		return IRC_SUCCESS;
+	}
+
+	int IRC::descriptor() const
+	{
+		return connected ? transport->descriptor() : -1;
+	}
+
+	int IRC::replay(const char* directory, unsigned long long from, unsigned long long to, const char* channel)
+	{
+		IRCLogReader reader;
+		if (reader.open(directory, from, to, channel) != IRC_SUCCESS)
+			return IRC_LOG_OPEN_FAILED;
+
+		// Don't record what is being played back, and don't let the library
+		// answer it either. Callbacks still run and may send as they like.
+		IRCRecorder* saved = recorder;
+		recorder = NULL;
+		replaying = true;
+
+		char buffer[1024];
+		IRCLogRecord record;
+		while (reader.next(&record))
+		{
+			if (record.direction != IRC_LOG_IN)
+				continue;
 
-			buffer[ret_len] = '\0';
-			split_to_replies(buffer);
+			unsigned int length = __IRC_MIN__(record.length, sizeof(buffer) - 1);
+			memcpy(buffer, record.line, length);
+			buffer[length] = '\0';
+			parse_irc_reply(buffer);
 		}
 
-		delete[] buffer;
+		replaying = false;
+		recorder = saved;
 		return IRC_SUCCESS;
 	}
 
@@ -144,22 +342,22 @@ namespace cpIRC
 		if (!connected)
 			return IRC_NOT_CONNECTED;
 
-		if (quit("Leaving") != IRC_SUCCESS)
-			return IRC_SEND_FAILED;
+		// The server may already have gone, in which case there is nobody
+		// to say goodbye to but the transport still has to be released.
+		quit("Leaving");
 
-		if (shutdown(ircSocket, 2))
-		{
+		int result = transport->close();
 #ifdef WIN32
-			prnt("[cpIRC]: Socket shutdown error. Last WSA error: %d\n", WSAGetLastError());
+		if (result != IRC_SUCCESS && prnt)
+			prnt("[cpIRC]: Socket close error. Last WSA error: %d\n", WSAGetLastError());
 #endif
-			return IRC_SOCKET_SHUTDOWN_FAILED;
-		}
 
-		if (closesocket(ircSocket))
-			return IRC_SOCKET_CLOSE_FAILED;
+		if (ownsTransport)
+			irc_delete(static_cast<IRCSocketTransport*>(transport)); // The only kind we create.
+		transport = NULL;
 
 		connected = false;
-		return IRC_SUCCESS;
+		return result;
 	}
 
 	int IRC::raw(const char* text)
@@ -167,6 +365,11 @@ namespace cpIRC
 		return irc_send("%s\r\n", text);
 	}
 
+	int IRC::raw(const char* text, IRCSendPolicy policy)
+	{
+		return irc_send(policy, "%s\r\n", text);
+	}
+
 	int IRC::pass(const char* password)
 	{
 		return irc_send("PASS %s\r\n", password);
@@ -305,11 +508,21 @@ namespace cpIRC
 		return irc_send("PRIVMSG %s :%s\r\n", receiver, text);
 	}
 
+	int IRC::privmsg(const char* receiver, const char* text, IRCSendPolicy policy)
+	{
+		return irc_send(policy, "PRIVMSG %s :%s\r\n", receiver, text);
+	}
+
 	int IRC::notice(const char* nickname, const char* text)
 	{
 		return irc_send("NOTICE %s :%s\r\n", nickname, text);
 	}
 
+	int IRC::notice(const char* nickname, const char* text, IRCSendPolicy policy)
+	{
+		return irc_send(policy, "NOTICE %s :%s\r\n", nickname, text);
+	}
+
 	int IRC::who(const char* name, bool operators)
 	{
 		int result;
@@ -421,22 +634,84 @@ namespace cpIRC
 	////////////////////
 	////////////////////
 
-	void IRC::callback(IRCReply* reply)
+	void IRC::add_callback(CallbackHandler** list, const char* cmd, IRCCallback function)
 	{
-		if (!callbackList)
-			return;
+		CallbackHandler* handler = irc_new<CallbackHandler>();
+		handler->next = NULL;
+		handler->callback = function;
 
-		CallbackHandler* p = callbackList;
+		unsigned int cmd_length = strlen(cmd) + 1;
+		handler->command = irc_new_array<char>(cmd_length);
+		irc_strcpy(handler->command, cmd_length + 1, cmd);
+
+		while (*list)
+			list = &(*list)->next;
+		*list = handler;
+	}
+
+	bool IRC::dispatch(CallbackHandler* list, const char* cmd, IRCReply* reply)
+	{
+		CallbackHandler* p = list;
 
 		while (p)
 		{
-			if (!strcmp(p->command, reply->command))
+			// A callback set to NULL is skipped rather than called.
+			if (p->callback && !strcmp(p->command, cmd))
 			{
-				(*(p->callback))(this, reply);
-				break;
+				p->callback(this, reply);
+				return true;
 			}
 			p = p->next;
 		}
+
+		return false;
+	}
+
+	bool IRC::filtered(IRCReply* reply)
+	{
+		// A filter callback returning non-zero swallows the message.
+		if (!filter || !filterCallback || strcmp(reply->command, "PRIVMSG"))
+			return false;
+
+		int rule = filter->match(reply);
+		return rule >= 0 && filterCallback(this, reply, rule);
+	}
+
+	void IRC::callback(IRCReply* reply)
+	{
+		if (filtered(reply))
+			return;
+
+		dispatch(callbackList, reply->command, reply);
+	}
+
+	void IRC::ctcp_callback(IRCReply* reply)
+	{
+		// Played back requests reach the callbacks, nothing answers them.
+		if (replaying)
+		{
+			dispatch(ctcpCallbackList, reply->ctcp, reply);
+			return;
+		}
+
+		bool isDcc = dcc && !strcmp(reply->ctcp, "DCC");
+
+		// RESUME and ACCEPT only ever match a transfer negotiated here.
+		if (isDcc && dcc->negotiate(reply))
+			return;
+
+		// Rate limits come first so floods never get further than this.
+		if (!ctcp->admit(reply))
+			return;
+
+		if (isDcc && dcc->offer(reply))
+			return;
+
+		if (dispatch(ctcpCallbackList, reply->ctcp, reply))
+			return;
+
+		if (!strcmp(reply->command, "PRIVMSG"))
+			ctcp->respond(this, reply);
 	}
 
 	void IRC::parse_irc_reply(char* message)
@@ -487,7 +762,7 @@ namespace cpIRC
 		
 		if (!strcmp(reply.command, "PING"))
 		{
-			if (!reply.params)
+			if (!reply.params || replaying)
 				return;
 
 			irc_send("PONG %s\r\n", &reply.params[1]);
@@ -497,76 +772,201 @@ namespace cpIRC
 				prnt("Ping-Pong\n");
 #endif
 		}
+		else if (reply.params && (!strcmp(reply.command, "PRIVMSG") || !strcmp(reply.command, "NOTICE")))
+		{
+			// CTCP is a trailing parameter framed by \x01. ACTION is plain
+			// chat and is left to the ordinary PRIVMSG callbacks.
+			char* trailing = reply.params[0] == ':' ? reply.params : strstr(reply.params, " :");
+			char* text = trailing ? strchr(trailing, ':') + 1 : NULL;
+			if (!text || *text != '\x01' || !strncmp(text + 1, "ACTION", 6))
+			{
+				callback(&reply);
+				return;
+			}
+
+			// The filter sees the whole text, before params is cut down.
+			if (filtered(&reply))
+				return;
+
+			*trailing = '\0';
+			reply.ctcp = text + 1;
+			char* end = strchr(reply.ctcp, '\x01');
+			if (end)
+				*end = '\0';
+			char* space = strchr(reply.ctcp, ' ');
+			if (space)
+			{
+				*space = '\0';
+				reply.ctcp_params = space + 1;
+			}
+
+			if (!*reply.ctcp)
+				return;
+
+			ctcp_callback(&reply);
+		}
 		else
 			callback(&reply);
 	}
 
-	void IRC::split_to_replies(char* data)
+	char* IRC::split_to_replies(char* data)
 	{
 		char* p = strstr(data, "\r\n");
 		while (p)
 		{
 			*p = '\0';
-			parse_irc_reply(data);
+			if (recorder)
+				recorder->record(IRC_LOG_IN, data, p - data);
+			if (bouncer)
+				bouncer->fan_out(data, p - data);
+
+			if (!inbound->enabled())
+				parse_irc_reply(data);
+			else
+			{
+				IRCInboundPolicy policy = inbound->classify(data);
+				if (policy == IRC_INBOUND_INLINE)
+					parse_irc_reply(data);
+				else
+					inbound->push(data, p - data, policy);
+			}
+
 			data = p + 2;
 			p = strstr(data, "\r\n");
 		}
+
+		return data;
 	}
 
 	void IRC::clear_callbacks()
 	{
-		while (callbackList)
+		clear_callbacks(&callbackList);
+		clear_callbacks(&ctcpCallbackList);
+	}
+
+	void IRC::clear_callbacks(CallbackHandler** list)
+	{
+		while (*list)
 		{
-			CallbackHandler* iter = callbackList;
-			callbackList = callbackList->next;
+			CallbackHandler* iter = *list;
+			*list = iter->next;
 
-			delete[] iter->command;
-			delete iter;
+			irc_delete_array(iter->command, strlen(iter->command) + 1);
+			irc_delete(iter);
 		}
-
-		callbackList = NULL;
 	}
 
 	void IRC::irc_strcpy(char* dest, const unsigned int destLen, const char* src)
 	{
 #ifdef WIN32
-		memcpy_s(dest, destLen, src, min(strlen(src), destLen));
+		memcpy_s(dest, destLen, src, __IRC_MIN__(strlen(src), destLen));
 #else
-		memcpy(dest, src, min(strlen(src), destLen));
+		memcpy(dest, src, __IRC_MIN__(strlen(src), destLen));
 #endif
 
 	}
 
 	int IRC::irc_send(const char* format, ...)
 	{
-		if (!connected)
-			return IRC_NOT_CONNECTED;
+		va_list va;
+		int result;
 
-		char buffer[512];
+		va_start(va, format);
+		result = irc_vsend(sendPolicy, format, va);
+		va_end(va);
+
+		return result;
+	}
+
+	int IRC::irc_send(IRCSendPolicy policy, const char* format, ...)
+	{
 		va_list va;
 		int result;
 
 		va_start(va, format);
+		result = irc_vsend(policy, format, va);
+		va_end(va);
+
+		return result;
+	}
+
+	int IRC::irc_vsend(IRCSendPolicy policy, const char* format, va_list va)
+	{
+		if (!connected)
+			return IRC_NOT_CONNECTED;
+
+		char buffer[512];
+
 		vsnprintf(buffer, 512, format, va);
 		buffer[511] = '\0';
-		va_end(va);
 
-		result = send(ircSocket, buffer, min(strlen(buffer), 512), 0) ? IRC_SUCCESS : IRC_SEND_FAILED;
+		unsigned int length = strlen(buffer);
+		while (!sendQueue->push(buffer, length))
+		{
+			if (policy == IRC_SEND_FAIL)
+				return IRC_SEND_QUEUE_FULL;
+
+			if (policy == IRC_SEND_DROP_OLDEST)
+			{
+				char dropped[512];
+				if (sendQueue->acquire_consumer())
+				{
+					sendQueue->pop(dropped, &length);
+					sendQueue->release_consumer();
+				}
+				length = strlen(buffer);
+			}
+			else
+				flush_send_queue();
+
+			std::this_thread::yield();
+		}
 
-		if (result == IRC_SUCCESS)
+		return flush_send_queue();
+	}
+
+	int IRC::flush_send_queue()
+	{
+		char buffer[513];
+		unsigned int length;
+		int result = IRC_SUCCESS;
+
+		// Whoever holds the consumer role writes for everybody, so lines
+		// never interleave on the transport.
+		while (sendQueue->acquire_consumer())
 		{
-			if (!strncmp(buffer, "PASS", 4))
+			while (sendQueue->pop(buffer, &length))
 			{
-				char* pointer = buffer + 5;
-				while (*pointer != '\r')
+				buffer[length] = '\0';
+
+				if (transport->send(buffer, length) != IRC_SUCCESS)
+				{
+					result = IRC_SEND_FAILED;
+					continue;
+				}
+
+				if (!strncmp(buffer, "PASS", 4))
 				{
-					*pointer = '*';
-					++pointer;
+					char* pointer = buffer + 5;
+					while (*pointer && *pointer != '\r')
+					{
+						*pointer = '*';
+						++pointer;
+					}
 				}
+				if (recorder)
+					recorder->record(IRC_LOG_OUT, buffer, strcspn(buffer, "\r\n"));
+				if (prnt)
+					prnt("C->S| %s", buffer);
 			}
-			if (prnt)
-				prnt("C->S| %s", buffer);
+
+			sendQueue->release_consumer();
+
+			// A producer may have pushed between our last pop and the release.
+			if (sendQueue->empty())
+				break;
 		}
+
 		return result;
 	}
 }
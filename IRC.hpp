@@ -23,12 +23,15 @@
 	IRC:	#magpie @ irc.quakenet.org
 */
 
+#pragma once
+
 #include <stdio.h>
 #include <stdarg.h>
 
 #ifdef _WIN64
 
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
+#define NOMINMAX
 #include <WinSock2.h>
 #pragma comment(lib, "Ws2_32.lib")
 #include <Windows.h>
@@ -38,18 +41,18 @@
 #include <unistd.h>
 #include <string.h>
 #include <netdb.h>
-#define closesocket(s) close(s)
+#define closesocket(s) ::close(s)
 #define SOCKET_ERROR -1
 #define INVALID_SOCKET -1
 
 #endif
 
+#include "IRC_alloc.hpp"
+#include "IRC_delegate.hpp"
 #include "IRC_errors.hpp"
 #include "IRC_responses.hpp"
 
-#ifndef min
-#define min(a, b) (a < b ? a : b)
-#endif
+#define __IRC_MIN__(a, b) ((a) < (b) ? (a) : (b))
 
 #define __CPIRC_VERSION__	0.1
 #define __IRC_DEBUG__ 1
@@ -67,7 +70,45 @@ namespace cpIRC
 		IRC_SEND_FAILED,
 		IRC_RECV_FAILED,
 		IRC_SOCKET_SHUTDOWN_FAILED,
-		IRC_SOCKET_CLOSE_FAILED
+		IRC_SOCKET_CLOSE_FAILED,
+		IRC_LOG_OPEN_FAILED,
+		IRC_LOG_WRITE_FAILED,
+		IRC_LOG_NOT_OPEN,
+		IRC_SEND_QUEUE_FULL,
+		IRC_CONNECTION_CLOSED,
+		IRC_DCC_FILE_FAILED,
+		IRC_DCC_NO_TRANSFER
+	};
+
+	// What a send does when the outgoing queue is full.
+	enum IRCSendPolicy
+	{
+		IRC_SEND_BLOCK = 0,
+		IRC_SEND_DROP_OLDEST,
+		IRC_SEND_FAIL
+	};
+
+	// How a received command is treated when callbacks fall behind.
+	enum IRCInboundPolicy
+	{
+		IRC_INBOUND_INLINE = 0,	// Handled as it is read, never queued.
+		IRC_INBOUND_KEEP,		// May use the whole queue.
+		IRC_INBOUND_NORMAL,		// Shed when the queue is nearly full.
+		IRC_INBOUND_BULK,		// Shed from half full.
+		IRC_INBOUND_DROP,		// Always shed.
+		IRC_INBOUND_POLICIES
+	};
+
+	struct IRCInboundStats
+	{
+		unsigned long long queued;
+		unsigned long long dispatched;
+		// Lines shed, by policy.
+		unsigned long long shed[IRC_INBOUND_POLICIES];
+		// Queued JOINs withdrawn along with a shed PART or QUIT.
+		unsigned long long coalesced;
+		unsigned int depth;
+		unsigned int peak;
 	};
 
 	struct IRCReply
@@ -80,8 +121,27 @@ namespace cpIRC
 		char* command;
 		// Params.
 		char* params;
+		// CTCP, when a PRIVMSG or NOTICE carried a \x01-framed message.
+		// params is then cut down to the target.
+		char* ctcp;
+		char* ctcp_params;
 	};
 
+	class IRCBouncer;
+	class IRCCtcp;
+	class IRCDcc;
+	class IRCFilter;
+	class IRCInboundQueue;
+	class IRCRecorder;
+	class IRCTransport;
+	class IRCSendQueue;
+
+	class IRC;
+
+	// Plain function pointers convert implicitly, lambdas may capture state.
+	typedef IRCDelegate<int(IRC*, IRCReply*)> IRCCallback;
+	typedef IRCDelegate<int(IRC*, IRCReply*, int)> IRCFilterCallback;
+
 	class IRC
 	{
 	public:
@@ -91,10 +151,35 @@ namespace cpIRC
 		// This class only.
 
 		int connect(const char* server, const short int port);
-		void set_callback(const char* cmd, int(*function_ptr)(IRC*, IRCReply*));
+		int connect(IRCTransport* transport);
+		void set_callback(const char* cmd, IRCCallback function);
+		void set_ctcp_callback(const char* ctcp, IRCCallback function);
+		void set_ctcp_limits(const unsigned int source_interval_ms, const unsigned int global_burst, const unsigned int global_interval_ms);
+		void set_ctcp_replies(const bool enabled);
+		unsigned long long ctcp_dropped() const;
+		int set_send_capacity(const unsigned int lines);
+		void set_send_policy(IRCSendPolicy policy);
+		// Queue received lines so slow callbacks don't stall reading, 0 (the default) dispatches inline.
+		int set_inbound_capacity(const unsigned int lines);
+		void set_inbound_policy(const char* command, const IRCInboundPolicy policy);
+		void inbound_stats(IRCInboundStats* stats) const;
+		bool inbound_pending() const;
+		// Runs callbacks for up to max_lines queued lines, returns how many.
+		unsigned int dispatch_inbound(const unsigned int max_lines);
+		void set_filter(IRCFilter* filter, IRCFilterCallback function);
+		void set_recorder(IRCRecorder* recorder);
+		void set_bouncer(IRCBouncer* bouncer);
+		void set_dcc(IRCDcc* dcc);
 		int message_loop();
+		// One read and dispatch, for callers running their own event loop.
+		int process_input();
+		int descriptor() const;
+		int replay(const char* directory, unsigned long long from, unsigned long long to, const char* channel);
+		// Frees the transport, so other threads must have stopped sending
+		// before this is called. Sends are only thread-safe while connected.
 		int disconnect();
 		int raw(const char* text);
+		int raw(const char* text, IRCSendPolicy policy);
 
 		// Connection registration.
 
@@ -126,7 +211,9 @@ namespace cpIRC
 		// Sending messages.
 
 		int privmsg(const char* receiver, const char* text);
+		int privmsg(const char* receiver, const char* text, IRCSendPolicy policy);
 		int notice(const char* nickname, const char* text);
+		int notice(const char* nickname, const char* text, IRCSendPolicy policy);
 
 		// User-based queries.
 
@@ -161,23 +248,46 @@ namespace cpIRC
 		struct CallbackHandler;
 		struct UserHandler;
 
+		void add_callback(CallbackHandler** list, const char* cmd, IRCCallback function);
+		bool dispatch(CallbackHandler* list, const char* cmd, IRCReply* reply);
+		void clear_callbacks(CallbackHandler** list);
+		bool filtered(IRCReply* reply);
 		void callback(IRCReply* reply);
+		void ctcp_callback(IRCReply* reply);
 		void parse_irc_reply(char* message);
-		void split_to_replies(char* data);
+		char* split_to_replies(char* data);
+		int read_input();
 		void clear_callbacks();
 		void irc_strcpy(char* dest, const unsigned int destLen, const char* src);
 		int irc_send(const char* format, ...);
-
-		int ircSocket;
+		int irc_send(IRCSendPolicy policy, const char* format, ...);
+		int irc_vsend(IRCSendPolicy policy, const char* format, va_list va);
+		int flush_send_queue();
+
+		IRCTransport* transport;
+		bool ownsTransport;
+		char recvBuffer[1024];
+		unsigned int recvPending;
+		bool replaying;
+		IRCSendQueue* sendQueue;
+		IRCSendPolicy sendPolicy;
+		IRCInboundQueue* inbound;
 		bool connected;
 		CallbackHandler* callbackList;
+		CallbackHandler* ctcpCallbackList;
+		IRCCtcp* ctcp;
+		IRCFilter* filter;
+		IRCFilterCallback filterCallback;
+		IRCRecorder* recorder;
+		IRCBouncer* bouncer;
+		IRCDcc* dcc;
 		void(*prnt)(const char* format, ...);
 	};
 
 	struct IRC::CallbackHandler
 	{
 		char* command;
-		int(*callback)(IRC*, IRCReply*);
+		IRCCallback callback;
 		CallbackHandler* next;
 	};
 }
@@ -0,0 +1,181 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include "IRC_alloc.hpp"
+
+namespace cpIRC
+{
+	static void* default_allocate(void*, size_t size)
+	{
+		return ::operator new(size);
+	}
+
+	static void default_deallocate(void*, void* pointer, size_t)
+	{
+		::operator delete(pointer);
+	}
+
+	static IRCAllocator currentAllocator = { default_allocate, default_deallocate, NULL };
+
+	void set_allocator(const IRCAllocator* allocator)
+	{
+		if (allocator)
+			currentAllocator = *allocator;
+		else
+		{
+			currentAllocator.allocate = default_allocate;
+			currentAllocator.deallocate = default_deallocate;
+			currentAllocator.context = NULL;
+		}
+	}
+
+	IRCAllocator get_allocator()
+	{
+		return currentAllocator;
+	}
+
+	void* irc_allocate(size_t size)
+	{
+		return currentAllocator.allocate(currentAllocator.context, size);
+	}
+
+	void irc_deallocate(void* pointer, size_t size)
+	{
+		currentAllocator.deallocate(currentAllocator.context, pointer, size);
+	}
+
+	IRCPool::IRCPool(size_t blockSize, unsigned int blocks)
+	{
+		const size_t align = alignof(std::max_align_t);
+
+		upstream = currentAllocator;
+		this->blockSize = ((blockSize < sizeof(void*) ? sizeof(void*) : blockSize) + align - 1) & ~(align - 1);
+		this->blocks = blocks;
+		memory = static_cast<char*>(upstream.allocate(upstream.context, this->blockSize * blocks));
+
+		// Thread the free list through the blocks themselves.
+		freeList = NULL;
+		for (unsigned int i = blocks; i-- > 0;)
+		{
+			void* block = memory + i * this->blockSize;
+			*static_cast<void**>(block) = freeList;
+			freeList = block;
+		}
+	}
+
+	IRCPool::~IRCPool()
+	{
+		upstream.deallocate(upstream.context, memory, blockSize * blocks);
+	}
+
+	void* IRCPool::allocate(size_t size)
+	{
+		if (size <= blockSize)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (freeList)
+			{
+				void* block = freeList;
+				freeList = *static_cast<void**>(block);
+				return block;
+			}
+		}
+
+		return upstream.allocate(upstream.context, size);
+	}
+
+	void IRCPool::deallocate(void* pointer, size_t size)
+	{
+		char* block = static_cast<char*>(pointer);
+		if (block < memory || block >= memory + blockSize * blocks)
+		{
+			upstream.deallocate(upstream.context, pointer, size);
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		*static_cast<void**>(pointer) = freeList;
+		freeList = pointer;
+	}
+
+	IRCAllocator IRCPool::allocator()
+	{
+		IRCAllocator result = { pool_allocate, pool_deallocate, this };
+		return result;
+	}
+
+	void* IRCPool::pool_allocate(void* context, size_t size)
+	{
+		return static_cast<IRCPool*>(context)->allocate(size);
+	}
+
+	void IRCPool::pool_deallocate(void* context, void* pointer, size_t size)
+	{
+		static_cast<IRCPool*>(context)->deallocate(pointer, size);
+	}
+
+	IRCAllocationCounter::IRCAllocationCounter()
+	{
+		upstream = currentAllocator;
+		allocated.store(0);
+		deallocated.store(0);
+	}
+
+	IRCAllocator IRCAllocationCounter::allocator()
+	{
+		IRCAllocator result = { counted_allocate, counted_deallocate, this };
+		return result;
+	}
+
+	unsigned long long IRCAllocationCounter::allocations() const
+	{
+		return allocated.load();
+	}
+
+	unsigned long long IRCAllocationCounter::deallocations() const
+	{
+		return deallocated.load();
+	}
+
+	void IRCAllocationCounter::reset()
+	{
+		allocated.store(0);
+		deallocated.store(0);
+	}
+
+	void* IRCAllocationCounter::counted_allocate(void* context, size_t size)
+	{
+		IRCAllocationCounter* counter = static_cast<IRCAllocationCounter*>(context);
+		counter->allocated.fetch_add(1, std::memory_order_relaxed);
+		return counter->upstream.allocate(counter->upstream.context, size);
+	}
+
+	void IRCAllocationCounter::counted_deallocate(void* context, void* pointer, size_t size)
+	{
+		IRCAllocationCounter* counter = static_cast<IRCAllocationCounter*>(context);
+		counter->deallocated.fetch_add(1, std::memory_order_relaxed);
+		counter->upstream.deallocate(counter->upstream.context, pointer, size);
+	}
+}
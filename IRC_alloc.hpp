@@ -0,0 +1,156 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Allocator hooks.
+//
+// Every allocation the library makes goes through the allocator installed
+// with set_allocator(), operator new by default. Memory is freed through
+// whichever allocator is current at the time, so install it before creating
+// any library objects and leave it alone until the last of them has been
+// destroyed. Once connected and warmed up, receiving, parsing, dispatching
+// and sending a message allocates nothing at all, and IRCAllocationCounter
+// is there to check that in tests.
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstddef>
+
+namespace cpIRC
+{
+	struct IRCAllocator
+	{
+		void* (*allocate)(void* context, size_t size);
+		void (*deallocate)(void* context, void* pointer, size_t size);
+		void* context;
+	};
+
+	// NULL restores the default.
+	void set_allocator(const IRCAllocator* allocator);
+	IRCAllocator get_allocator();
+
+	void* irc_allocate(size_t size);
+	void irc_deallocate(void* pointer, size_t size);
+
+	template<typename T, typename... Args>
+	T* irc_new(Args&&... args)
+	{
+		return new (irc_allocate(sizeof(T))) T(static_cast<Args&&>(args)...);
+	}
+
+	template<typename T>
+	void irc_delete(T* object)
+	{
+		if (!object)
+			return;
+		object->~T();
+		irc_deallocate(object, sizeof(T));
+	}
+
+	template<typename T>
+	T* irc_new_array(size_t count)
+	{
+		T* objects = static_cast<T*>(irc_allocate(count * sizeof(T)));
+		for (size_t i = 0; i < count; ++i)
+			new (objects + i) T();
+		return objects;
+	}
+
+	template<typename T>
+	void irc_delete_array(T* objects, size_t count)
+	{
+		if (!objects)
+			return;
+		for (size_t i = 0; i < count; ++i)
+			objects[i].~T();
+		irc_deallocate(objects, count * sizeof(T));
+	}
+
+	// For standard containers.
+	template<typename T>
+	struct IRCStdAllocator
+	{
+		typedef T value_type;
+
+		IRCStdAllocator() {}
+		template<typename U> IRCStdAllocator(const IRCStdAllocator<U>&) {}
+
+		T* allocate(size_t count) { return static_cast<T*>(irc_allocate(count * sizeof(T))); }
+		void deallocate(T* pointer, size_t count) { irc_deallocate(pointer, count * sizeof(T)); }
+
+		template<typename U> bool operator==(const IRCStdAllocator<U>&) const { return true; }
+		template<typename U> bool operator!=(const IRCStdAllocator<U>&) const { return false; }
+	};
+
+	// Fixed-size blocks carved from one allocation. Larger requests, and any
+	// request once the pool runs dry, go to the allocator that was current
+	// when the pool was made.
+	class IRCPool
+	{
+	public:
+		IRCPool(size_t blockSize, unsigned int blocks);
+		~IRCPool();
+
+		void* allocate(size_t size);
+		void deallocate(void* pointer, size_t size);
+		IRCAllocator allocator();
+
+	private:
+		IRCPool(const IRCPool&);
+		IRCPool& operator=(const IRCPool&);
+
+		static void* pool_allocate(void* context, size_t size);
+		static void pool_deallocate(void* context, void* pointer, size_t size);
+
+		IRCAllocator upstream;
+		char* memory;
+		size_t blockSize;
+		unsigned int blocks;
+		void* freeList;
+		std::mutex lock;
+	};
+
+	// Counts what passes through it on the way to the allocator that was
+	// current when it was made.
+	class IRCAllocationCounter
+	{
+	public:
+		IRCAllocationCounter();
+
+		IRCAllocator allocator();
+		unsigned long long allocations() const;
+		unsigned long long deallocations() const;
+		void reset();
+
+	private:
+		static void* counted_allocate(void* context, size_t size);
+		static void counted_deallocate(void* context, void* pointer, size_t size);
+
+		IRCAllocator upstream;
+		std::atomic<unsigned long long> allocated;
+		std::atomic<unsigned long long> deallocated;
+	};
+}
@@ -0,0 +1,624 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <chrono>
+#include <stddef.h>
+
+#ifndef _WIN64
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#endif
+
+#include "IRC_bouncer.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace cpIRC
+{
+	static const unsigned int bouncerMaxClients = 64;
+	static const unsigned int bouncerClientQueue = 1024;
+	// A replayed backlog may fill at most this much of a new client's queue.
+	static const unsigned int bouncerMaxBacklog = bouncerClientQueue / 2;
+	// Queued upstream lines dispatched per idle round.
+	static const unsigned int bouncerDispatchBatch = 16;
+
+	struct IRCBouncer::Line
+	{
+		unsigned int refs;
+		unsigned int length;
+		char data[1];
+	};
+
+	struct IRCBouncer::Client
+	{
+		int sock;
+		bool dead;
+		bool gotNick;
+		bool gotUser;
+		bool registered;
+		char nick[64];
+
+		char input[1024];
+		unsigned int inputLength;
+
+		// Write queue of shared lines, the first one possibly half sent.
+		Line* queue[bouncerClientQueue];
+		unsigned int queueHead;
+		unsigned int queueCount;
+		unsigned int queueOffset;
+	};
+
+	static unsigned long long milliseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+#ifndef _WIN64
+
+	IRCBouncer::IRCBouncer(IRC* upstream, void(*printFunction)(const char* fmt, ...)) : pending(512)
+	{
+		this->upstream = upstream;
+		prnt = printFunction;
+		listener = -1;
+		strcpy(nick, "*");
+
+		backlog = NULL;
+		backlogSize = 0;
+		backlogHead = 0;
+		backlogCount = 0;
+		set_backlog(200);
+
+		clients = irc_new_array<Client*>(bouncerMaxClients);
+		clientCount = 0;
+
+		floodBurst = 5;
+		floodInterval = 2000;
+		floodTime = 0;
+
+		upstream->set_bouncer(this);
+	}
+
+	IRCBouncer::~IRCBouncer()
+	{
+		upstream->set_bouncer(NULL);
+
+		while (clientCount)
+			drop_client(clientCount - 1);
+		irc_delete_array(clients, bouncerMaxClients);
+
+		set_backlog(0);
+
+		if (listener >= 0)
+			closesocket(listener);
+	}
+
+	int IRCBouncer::listen(const short int port)
+	{
+		sockaddr_in local;
+		int yes = 1;
+
+		if (listener >= 0)
+			return IRC_ALREADY_CONNECTED;
+
+		listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listener < 0)
+			return IRC_SOCKET_CREATION_FAILED;
+
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		local.sin_port = htons(port);
+
+		if (bind(listener, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) || ::listen(listener, 16))
+		{
+			closesocket(listener);
+			listener = -1;
+			return IRC_SOCKET_CONNECT_FAILED;
+		}
+
+		return IRC_SUCCESS;
+	}
+
+	int IRCBouncer::listen_unix(const char* path)
+	{
+		sockaddr_un local;
+
+		if (listener >= 0)
+			return IRC_ALREADY_CONNECTED;
+
+		if (strlen(path) >= sizeof(local.sun_path))
+			return IRC_RESOLVE_FAILED;
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+			return IRC_SOCKET_CREATION_FAILED;
+
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		strcpy(local.sun_path, path);
+		unlink(path);
+
+		if (bind(listener, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) || ::listen(listener, 16))
+		{
+			closesocket(listener);
+			listener = -1;
+			return IRC_SOCKET_CONNECT_FAILED;
+		}
+
+		return IRC_SUCCESS;
+	}
+
+	void IRCBouncer::set_backlog(const unsigned int lines)
+	{
+		for (unsigned int i = 0; i < backlogCount; ++i)
+			release(backlog[(backlogHead + i) % backlogSize]);
+		irc_delete_array(backlog, backlogSize);
+
+		backlogSize = __IRC_MIN__(lines, bouncerMaxBacklog);
+		backlog = backlogSize ? irc_new_array<Line*>(backlogSize) : NULL;
+		backlogHead = 0;
+		backlogCount = 0;
+	}
+
+	void IRCBouncer::set_flood_control(const unsigned int burst, const unsigned int interval_ms)
+	{
+		floodBurst = burst ? burst : 1;
+		floodInterval = interval_ms;
+	}
+
+	int IRCBouncer::run()
+	{
+		if (listener < 0)
+			return IRC_NOT_CONNECTED;
+
+		pollfd fds[2 + bouncerMaxClients];
+
+		while (1)
+		{
+			int timeout = pump_upstream();
+			if (upstream->inbound_pending())
+				timeout = 0;
+
+			fds[0].fd = upstream->descriptor();
+			fds[0].events = POLLIN;
+			fds[1].fd = listener;
+			fds[1].events = POLLIN;
+
+			unsigned int polled = clientCount;
+			for (unsigned int i = 0; i < polled; ++i)
+			{
+				fds[2 + i].fd = clients[i]->sock;
+				fds[2 + i].events = POLLIN | (clients[i]->queueCount ? POLLOUT : 0);
+			}
+
+			if (poll(fds, 2 + polled, timeout) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return IRC_RECV_FAILED;
+			}
+
+			if (fds[0].revents)
+			{
+				int result = upstream->process_input();
+				if (result != IRC_SUCCESS)
+				{
+					while (clientCount)
+						drop_client(clientCount - 1);
+					return result == IRC_CONNECTION_CLOSED ? IRC_SUCCESS : result;
+				}
+			}
+			else
+				upstream->dispatch_inbound(bouncerDispatchBatch);
+
+			for (unsigned int i = 0; i < polled; ++i)
+				if (fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR))
+					read_client(clients[i]);
+
+			if (fds[1].revents & POLLIN)
+				accept_client();
+
+			// Write straight away rather than waiting for the next POLLOUT.
+			for (unsigned int i = clientCount; i-- > 0;)
+			{
+				if (!clients[i]->dead && clients[i]->queueCount)
+					flush_client(clients[i]);
+				if (clients[i]->dead)
+					drop_client(i);
+			}
+		}
+	}
+
+	void IRCBouncer::fan_out(const char* line, const unsigned int length)
+	{
+		// The upstream IRC answers PINGs itself.
+		if (length >= 5 && !strncmp(line, "PING ", 5))
+			return;
+
+		track_nick(line, length);
+
+		Line* shared = make_line(line, length);
+
+		if (backlogSize)
+		{
+			if (backlogCount == backlogSize)
+			{
+				release(backlog[backlogHead]);
+				backlogHead = (backlogHead + 1) % backlogSize;
+				--backlogCount;
+			}
+			backlog[(backlogHead + backlogCount++) % backlogSize] = shared;
+			++shared->refs;
+		}
+
+		for (unsigned int i = 0; i < clientCount; ++i)
+			if (clients[i]->registered)
+				enqueue(clients[i], shared);
+
+		++shared->refs;
+		release(shared);
+	}
+
+	void IRCBouncer::track_nick(const char* line, const unsigned int length)
+	{
+		char buffer[512];
+		unsigned int size = __IRC_MIN__(length, sizeof(buffer) - 1);
+		memcpy(buffer, line, size);
+		buffer[size] = '\0';
+
+		char* prefix = NULL;
+		char* command = buffer;
+		if (*command == ':')
+		{
+			prefix = command + 1;
+			command = strchr(command, ' ');
+			if (!command)
+				return;
+			*command++ = '\0';
+		}
+
+		char* params = strchr(command, ' ');
+		if (!params)
+			return;
+		*params++ = '\0';
+
+		const char* newNick = NULL;
+		if (!strcmp(command, "001"))
+			newNick = params; // :server 001 <nick> :Welcome...
+		else if (!strcasecmp(command, "NICK") && prefix)
+		{
+			// Only our own change, :old!user@host NICK :new
+			unsigned int oldLength = strcspn(prefix, "!@");
+			if (oldLength == strlen(nick) && !strncasecmp(prefix, nick, oldLength))
+				newNick = *params == ':' ? params + 1 : params;
+		}
+
+		if (newNick && *newNick)
+		{
+			unsigned int nickLength = __IRC_MIN__(strcspn(newNick, " "), sizeof(nick) - 1);
+			memcpy(nick, newNick, nickLength);
+			nick[nickLength] = '\0';
+		}
+	}
+
+	IRCBouncer::Line* IRCBouncer::make_line(const char* text, const unsigned int length)
+	{
+		Line* line = static_cast<Line*>(irc_allocate(offsetof(Line, data) + length + 2));
+
+		line->refs = 0;
+		line->length = length + 2;
+		memcpy(line->data, text, length);
+		line->data[length] = '\r';
+		line->data[length + 1] = '\n';
+		return line;
+	}
+
+	void IRCBouncer::release(Line* line)
+	{
+		if (!--line->refs)
+			irc_deallocate(line, offsetof(Line, data) + line->length);
+	}
+
+	void IRCBouncer::enqueue(Client* client, Line* line)
+	{
+		if (client->dead)
+			return;
+
+		// A client this far behind is not keeping up, cut it loose.
+		if (client->queueCount == bouncerClientQueue)
+		{
+			if (prnt)
+				prnt("[cpIRC]: Bouncer client %d too slow, dropping\n", client->sock);
+			client->dead = true;
+			return;
+		}
+
+		client->queue[(client->queueHead + client->queueCount++) % bouncerClientQueue] = line;
+		++line->refs;
+	}
+
+	void IRCBouncer::reply(Client* client, const char* format, ...)
+	{
+		char buffer[512];
+		va_list va;
+
+		va_start(va, format);
+		vsnprintf(buffer, sizeof(buffer) - 2, format, va);
+		va_end(va);
+
+		Line* line = make_line(buffer, strlen(buffer));
+		++line->refs;
+		enqueue(client, line);
+		release(line);
+	}
+
+	void IRCBouncer::accept_client()
+	{
+		int sock = accept(listener, NULL, NULL);
+		if (sock < 0)
+			return;
+
+		if (clientCount == bouncerMaxClients)
+		{
+			closesocket(sock);
+			return;
+		}
+
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+		Client* client = irc_new<Client>();
+		client->sock = sock;
+		client->dead = false;
+		client->gotNick = false;
+		client->gotUser = false;
+		client->registered = false;
+		strcpy(client->nick, "*");
+		client->inputLength = 0;
+		client->queueHead = 0;
+		client->queueCount = 0;
+		client->queueOffset = 0;
+
+		clients[clientCount++] = client;
+	}
+
+	void IRCBouncer::read_client(Client* client)
+	{
+		int ret_len = recv(client->sock, client->input + client->inputLength, sizeof(client->input) - 1 - client->inputLength, 0);
+		if (ret_len <= 0)
+		{
+			if (!ret_len || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+				client->dead = true;
+			return;
+		}
+
+		client->inputLength += ret_len;
+		client->input[client->inputLength] = '\0';
+
+		char* data = client->input;
+		char* p;
+		while ((p = strchr(data, '\n')))
+		{
+			*p = '\0';
+			if (p > data && p[-1] == '\r')
+				p[-1] = '\0';
+			if (*data)
+				handle_client_line(client, data);
+			data = p + 1;
+		}
+
+		client->inputLength = strlen(data);
+		if (client->inputLength == sizeof(client->input) - 1)
+			client->inputLength = 0; // No line is that long, drop it.
+		memmove(client->input, data, client->inputLength);
+	}
+
+	void IRCBouncer::handle_client_line(Client* client, char* line)
+	{
+		char* params = strchr(line, ' ');
+		unsigned int commandLength = params ? params - line : strlen(line);
+		if (params)
+			++params;
+
+		if (commandLength == 4 && !strncasecmp(line, "PING", 4))
+			reply(client, ":cpIRC PONG cpIRC :%s", params ? (*params == ':' ? params + 1 : params) : "");
+		else if (commandLength == 4 && !strncasecmp(line, "NICK", 4) && !client->registered)
+		{
+			if (params)
+			{
+				unsigned int length = __IRC_MIN__(strcspn(params, " "), sizeof(client->nick) - 1);
+				memcpy(client->nick, params, length);
+				client->nick[length] = '\0';
+				client->gotNick = true;
+			}
+		}
+		else if (commandLength == 4 && !strncasecmp(line, "USER", 4))
+			client->gotUser = true;
+		else if (commandLength == 4 && !strncasecmp(line, "QUIT", 4))
+			client->dead = true;
+		else if ((commandLength == 4 && (!strncasecmp(line, "PASS", 4) || !strncasecmp(line, "PONG", 4))) ||
+			(commandLength == 3 && !strncasecmp(line, "CAP", 3)))
+			return;
+		else if (client->registered)
+		{
+			if (!pending.push(line, strlen(line)))
+				reply(client, ":cpIRC NOTICE %s :Upstream queue full, command dropped", nick);
+			return;
+		}
+
+		if (!client->registered && client->gotNick && client->gotUser)
+		{
+			client->registered = true;
+			// The client takes on whatever nick the upstream connection has.
+			reply(client, ":cpIRC 001 %s :Attached to the shared upstream connection", strcmp(nick, "*") ? nick : client->nick);
+
+			// Skip the oldest lines if the client has a lot queued already, a
+			// replay must never be what gets it dropped as too slow.
+			unsigned int room = bouncerClientQueue - client->queueCount;
+			unsigned int skip = backlogCount >= room ? backlogCount - room + 1 : 0;
+			for (unsigned int i = skip; i < backlogCount; ++i)
+				enqueue(client, backlog[(backlogHead + i) % backlogSize]);
+		}
+	}
+
+	void IRCBouncer::flush_client(Client* client)
+	{
+		while (client->queueCount)
+		{
+			iovec iov[64];
+			unsigned int count = 0;
+
+			for (; count < 64 && count < client->queueCount; ++count)
+			{
+				Line* line = client->queue[(client->queueHead + count) % bouncerClientQueue];
+				iov[count].iov_base = line->data;
+				iov[count].iov_len = line->length;
+			}
+			iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + client->queueOffset;
+			iov[0].iov_len -= client->queueOffset;
+
+			msghdr message;
+			memset(&message, 0, sizeof(message));
+			message.msg_iov = iov;
+			message.msg_iovlen = count;
+
+			ssize_t written = sendmsg(client->sock, &message, MSG_NOSIGNAL);
+			if (written < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					client->dead = true;
+				return;
+			}
+
+			// Release whatever went out completely.
+			size_t left = written;
+			for (unsigned int i = 0; i < count && left >= iov[i].iov_len; ++i)
+			{
+				left -= iov[i].iov_len;
+				release(client->queue[client->queueHead]);
+				client->queueHead = (client->queueHead + 1) % bouncerClientQueue;
+				--client->queueCount;
+				client->queueOffset = 0;
+			}
+
+			if (left)
+			{
+				client->queueOffset += left;
+				return;
+			}
+		}
+	}
+
+	void IRCBouncer::drop_client(unsigned int index)
+	{
+		Client* client = clients[index];
+
+		while (client->queueCount)
+		{
+			release(client->queue[client->queueHead]);
+			client->queueHead = (client->queueHead + 1) % bouncerClientQueue;
+			--client->queueCount;
+		}
+
+		closesocket(client->sock);
+		irc_delete(client);
+
+		clients[index] = clients[--clientCount];
+	}
+
+	int IRCBouncer::pump_upstream()
+	{
+		unsigned long long now = milliseconds();
+		unsigned long long window = static_cast<unsigned long long>(floodBurst) * floodInterval;
+		char line[513];
+		unsigned int length;
+
+		if (floodTime < now)
+			floodTime = now;
+
+		// Each line adds one interval of penalty, at most a burst's worth may be outstanding.
+		while (floodTime + floodInterval <= now + window)
+		{
+			if (!pending.pop(line, &length))
+				return -1;
+
+			line[length] = '\0';
+			upstream->raw(line);
+			floodTime += floodInterval;
+		}
+
+		return pending.empty() ? -1 : static_cast<int>(floodTime + floodInterval - window - now);
+	}
+
+#else
+
+	IRCBouncer::IRCBouncer(IRC* upstream, void(*printFunction)(const char* fmt, ...)) : pending(1)
+	{
+		this->upstream = upstream;
+		prnt = printFunction;
+	}
+
+	IRCBouncer::~IRCBouncer()
+	{
+	}
+
+	int IRCBouncer::listen(const short int)
+	{
+		return IRC_SOCKET_CREATION_FAILED;
+	}
+
+	int IRCBouncer::listen_unix(const char*)
+	{
+		return IRC_SOCKET_CREATION_FAILED;
+	}
+
+	void IRCBouncer::set_backlog(const unsigned int)
+	{
+	}
+
+	void IRCBouncer::set_flood_control(const unsigned int, const unsigned int)
+	{
+	}
+
+	int IRCBouncer::run()
+	{
+		return IRC_NOT_CONNECTED;
+	}
+
+	void IRCBouncer::fan_out(const char*, const unsigned int)
+	{
+	}
+
+#endif
+}
@@ -0,0 +1,100 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Bouncer mode: one upstream IRC connection shared by many local clients.
+//
+// run() drives the upstream connection and a listening socket from one
+// poll loop. Every line received upstream is stored once in a refcounted
+// buffer that the backlog and each client's write queue point at. Client
+// registration (PASS/NICK/USER/CAP) and PINGs are answered locally, other
+// commands, including a later NICK, go upstream through a flood-controlled
+// queue. New clients are welcomed under the upstream nick and get the
+// backlog replayed right after registering. POSIX only.
+
+#include "IRC_queue.hpp"
+
+namespace cpIRC
+{
+	class IRCBouncer
+	{
+	public:
+		IRCBouncer(IRC* upstream, void(*printFunction)(const char* fmt, ...));
+		~IRCBouncer();
+
+		int listen(const short int port);
+		int listen_unix(const char* path);
+		// Capped at half a client's write queue.
+		void set_backlog(const unsigned int lines);
+		// Up to burst lines at once, then one per interval.
+		void set_flood_control(const unsigned int burst, const unsigned int interval_ms);
+
+		// Runs until the upstream connection closes. Don't call the
+		// upstream message_loop() alongside it.
+		int run();
+
+		// Called by IRC for every line received upstream.
+		void fan_out(const char* line, const unsigned int length);
+
+	private:
+		IRCBouncer(const IRCBouncer&);
+		IRCBouncer& operator=(const IRCBouncer&);
+
+		struct Line;
+		struct Client;
+
+		Line* make_line(const char* text, const unsigned int length);
+		void release(Line* line);
+		void enqueue(Client* client, Line* line);
+		void reply(Client* client, const char* format, ...);
+
+		void accept_client();
+		void read_client(Client* client);
+		void handle_client_line(Client* client, char* line);
+		void track_nick(const char* line, const unsigned int length);
+		void flush_client(Client* client);
+		void drop_client(unsigned int index);
+		int pump_upstream();
+
+		IRC* upstream;
+		void(*prnt)(const char* format, ...);
+		int listener;
+		// The upstream connection's nick, from 001 and its own NICK changes.
+		char nick[64];
+
+		Line** backlog;
+		unsigned int backlogSize;
+		unsigned int backlogHead;
+		unsigned int backlogCount;
+
+		Client** clients;
+		unsigned int clientCount;
+
+		IRCSendQueue pending;
+		unsigned int floodBurst;
+		unsigned int floodInterval;
+		unsigned long long floodTime;
+	};
+}
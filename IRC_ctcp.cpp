@@ -0,0 +1,204 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <chrono>
+#include <time.h>
+
+#include "IRC_ctcp.hpp"
+
+#define __IRC_STR__(x) #x
+#define __IRC_XSTR__(x) __IRC_STR__(x)
+
+namespace cpIRC
+{
+	// Targets per coalesced NOTICE, the common TARGMAX.
+	static const unsigned int ctcpMaxTargets = 4;
+
+	static const char* ctcpNames[] = { "VERSION", "TIME", "CLIENTINFO" };
+
+	static unsigned long long milliseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static unsigned int nick_hash(const char* nick)
+	{
+		unsigned int hash = 2166136261u;
+		for (; *nick; ++nick)
+		{
+			unsigned char ch = *nick;
+			if (ch >= 'A' && ch <= 'Z')
+				ch += 'a' - 'A';
+			hash = (hash ^ ch) * 16777619u;
+		}
+		return hash ? hash : 1;
+	}
+
+	IRCCtcp::IRCCtcp()
+	{
+		replies = true;
+		sourceInterval = 2000;
+		globalBurst = 5;
+		globalInterval = 1000;
+		globalTime = 0;
+		droppedCount = 0;
+		memset(sources, 0, sizeof(sources));
+		memset(pending, 0, sizeof(pending));
+	}
+
+	void IRCCtcp::set_limits(const unsigned int source_interval_ms, const unsigned int global_burst, const unsigned int global_interval_ms)
+	{
+		sourceInterval = source_interval_ms;
+		globalBurst = global_burst ? global_burst : 1;
+		globalInterval = global_interval_ms;
+		globalTime = 0;
+	}
+
+	void IRCCtcp::set_replies(const bool enabled)
+	{
+		replies = enabled;
+	}
+
+	unsigned long long IRCCtcp::dropped() const
+	{
+		return droppedCount;
+	}
+
+	bool IRCCtcp::admit(const IRCReply* reply)
+	{
+		unsigned long long now = milliseconds();
+		Source* source = NULL;
+		unsigned int hash = 0;
+
+		if (reply->nick)
+		{
+			hash = nick_hash(reply->nick);
+			source = &sources[hash & 63];
+			if (source->hash == hash && now - source->last < sourceInterval)
+			{
+				++droppedCount;
+				return false;
+			}
+		}
+
+		// Each message adds one interval of penalty, at most a burst's worth may be outstanding.
+		if (globalTime < now)
+			globalTime = now;
+		if (globalTime + globalInterval > now + static_cast<unsigned long long>(globalBurst) * globalInterval)
+		{
+			++droppedCount;
+			return false;
+		}
+		globalTime += globalInterval;
+
+		if (source)
+		{
+			source->hash = hash;
+			source->last = now;
+		}
+		return true;
+	}
+
+	bool IRCCtcp::respond(IRC* irc, const IRCReply* reply)
+	{
+		if (!replies || !reply->nick)
+			return false;
+
+		if (!strcmp(reply->ctcp, "PING"))
+		{
+			char text[512];
+			snprintf(text, sizeof(text), "\x01PING %s\x01", reply->ctcp_params ? reply->ctcp_params : "");
+			irc->notice(reply->nick, text, IRC_SEND_FAIL);
+			return true;
+		}
+
+		for (int kind = 0; kind < CTCP_COALESCED; ++kind)
+		{
+			if (!strcmp(reply->ctcp, ctcpNames[kind]))
+			{
+				queue(irc, kind, reply->nick);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void IRCCtcp::flush(IRC* irc)
+	{
+		for (int kind = 0; kind < CTCP_COALESCED; ++kind)
+			flush(irc, kind);
+	}
+
+	void IRCCtcp::queue(IRC* irc, const int kind, const char* nick)
+	{
+		Pending* p = &pending[kind];
+		unsigned int length = strlen(nick);
+
+		if (length + 1 >= sizeof(p->targets))
+			return;
+
+		if (p->count == ctcpMaxTargets || p->length + length + 2 > sizeof(p->targets))
+			flush(irc, kind);
+
+		if (p->count)
+			p->targets[p->length++] = ',';
+		memcpy(p->targets + p->length, nick, length + 1);
+		p->length += length;
+		++p->count;
+	}
+
+	void IRCCtcp::flush(IRC* irc, const int kind)
+	{
+		Pending* p = &pending[kind];
+		if (!p->count)
+			return;
+
+		char text[256];
+		switch (kind)
+		{
+		case CTCP_VERSION:
+			snprintf(text, sizeof(text), "\x01VERSION cpIRC " __IRC_XSTR__(__CPIRC_VERSION__) "\x01");
+			break;
+
+		case CTCP_TIME:
+			{
+				time_t now = time(NULL);
+				char stamp[64];
+				strftime(stamp, sizeof(stamp), "%a %b %d %H:%M:%S %Y", localtime(&now));
+				snprintf(text, sizeof(text), "\x01TIME %s\x01", stamp);
+			}
+			break;
+
+		default:
+			snprintf(text, sizeof(text), "\x01" "CLIENTINFO ACTION CLIENTINFO PING TIME VERSION\x01");
+			break;
+		}
+
+		irc->notice(p->targets, text, IRC_SEND_FAIL);
+		p->length = 0;
+		p->count = 0;
+	}
+}
@@ -0,0 +1,89 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// CTCP flood control and built-in responders.
+//
+// Every CTCP message has to get past a per-source minimum interval and a
+// global token bucket before anything looks at it, so a botnet flood costs
+// a hash lookup per line and never reaches application code. VERSION, TIME
+// and CLIENTINFO requests that arrive close together are answered with a
+// single NOTICE to several targets, flushed after each read.
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	class IRCCtcp
+	{
+	public:
+		IRCCtcp();
+
+		void set_limits(const unsigned int source_interval_ms, const unsigned int global_burst, const unsigned int global_interval_ms);
+		void set_replies(const bool enabled);
+		unsigned long long dropped() const;
+
+		// False when the message should be thrown away.
+		bool admit(const IRCReply* reply);
+		// True when a built-in responder took the request.
+		bool respond(IRC* irc, const IRCReply* reply);
+		void flush(IRC* irc);
+
+	private:
+		enum CoalescedReply
+		{
+			CTCP_VERSION = 0,
+			CTCP_TIME,
+			CTCP_CLIENTINFO,
+			CTCP_COALESCED
+		};
+
+		struct Source
+		{
+			unsigned int hash;
+			unsigned long long last;
+		};
+
+		struct Pending
+		{
+			char targets[256];
+			unsigned int length;
+			unsigned int count;
+		};
+
+		void queue(IRC* irc, const int kind, const char* nick);
+		void flush(IRC* irc, const int kind);
+
+		bool replies;
+		unsigned int sourceInterval;
+		unsigned int globalBurst;
+		unsigned int globalInterval;
+		unsigned long long globalTime;
+		unsigned long long droppedCount;
+
+		Source sources[64];
+		Pending pending[CTCP_COALESCED];
+	};
+}
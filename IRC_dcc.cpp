@@ -0,0 +1,808 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <chrono>
+
+#ifndef _WIN64
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#endif
+
+#include "IRC_dcc.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace cpIRC
+{
+	static const unsigned int dccMaxTransfers = 64;
+	// Transfers that make no progress for this long are failed.
+	static const unsigned long long dccTimeout = 120000;
+	// Largest single sendfile() call, so one transfer can't starve the rest.
+	static const unsigned int dccSendChunk = 1 << 20;
+	// Queued IRC lines dispatched per idle step().
+	static const unsigned int dccDispatchBatch = 16;
+
+	struct IRCDcc::Transfer
+	{
+		unsigned int id;
+		bool outgoing;
+		IRCDccState state;
+		char nick[64];
+		char file[256];
+
+		int fd;
+		int sock;
+		unsigned int peerAddress;
+		unsigned short port;
+
+		unsigned long long size;
+		unsigned long long position;
+		unsigned long long offset;
+
+		// Acknowledgements from the receiver, 32 bit network order counts.
+		unsigned char ack[4];
+		unsigned int ackLength;
+		unsigned int acked;
+
+		unsigned long long created;
+		unsigned long long started;
+		unsigned long long finished;
+		unsigned long long lastActivity;
+	};
+
+	static unsigned long long milliseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+#ifndef _WIN64
+
+	static void set_nonblocking(int sock)
+	{
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+	}
+
+	IRCDcc::IRCDcc(IRC* irc, void(*printFunction)(const char* fmt, ...))
+	{
+		this->irc = irc;
+		prnt = printFunction;
+		strcpy(directory, ".");
+		address = INADDR_LOOPBACK;
+		nextId = 1;
+
+		transfers = irc_new_array<Transfer*>(dccMaxTransfers);
+		transferCount = 0;
+
+		irc->set_dcc(this);
+	}
+
+	IRCDcc::~IRCDcc()
+	{
+		irc->set_dcc(NULL);
+
+		while (transferCount)
+		{
+			Transfer* transfer = transfers[transferCount - 1];
+			if (transfer->fd >= 0)
+				::close(transfer->fd);
+			if (transfer->sock >= 0)
+				closesocket(transfer->sock);
+			remove(transferCount - 1);
+		}
+		irc_delete_array(transfers, dccMaxTransfers);
+	}
+
+	void IRCDcc::set_directory(const char* path)
+	{
+		snprintf(directory, sizeof(directory), "%s", path);
+	}
+
+	void IRCDcc::set_address(const unsigned int address)
+	{
+		this->address = address;
+	}
+
+	void IRCDcc::set_callback(IRCDccCallback function)
+	{
+		callback = function;
+	}
+
+	int IRCDcc::send_file(const char* nick, const char* path, unsigned int* id)
+	{
+		struct stat info;
+
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return IRC_DCC_FILE_FAILED;
+		if (fstat(fd, &info) || !S_ISREG(info.st_mode))
+		{
+			::close(fd);
+			return IRC_DCC_FILE_FAILED;
+		}
+
+		// Offer the bare name, spaces would need quoting some clients don't understand.
+		const char* name = strrchr(path, '/');
+		name = name ? name + 1 : path;
+
+		Transfer* transfer = add(nick, name, true);
+		if (!transfer)
+		{
+			::close(fd);
+			return IRC_DCC_NO_TRANSFER;
+		}
+		for (char* p = transfer->file; *p; ++p)
+			if (*p == ' ')
+				*p = '_';
+		transfer->fd = fd;
+		transfer->size = info.st_size;
+
+		int result = open_listener(transfer);
+		if (result != IRC_SUCCESS)
+		{
+			finish(transfer, IRC_DCC_FAILED);
+			return result;
+		}
+
+		char text[512];
+		snprintf(text, sizeof(text), "\x01" "DCC SEND %s %u %u %llu\x01", transfer->file, address, transfer->port, transfer->size);
+		result = irc->privmsg(nick, text);
+		if (result != IRC_SUCCESS)
+		{
+			finish(transfer, IRC_DCC_FAILED);
+			return result;
+		}
+
+		if (id)
+			*id = transfer->id;
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::accept(const unsigned int id)
+	{
+		Transfer* transfer = find(id);
+		if (!transfer || transfer->outgoing || transfer->state != IRC_DCC_OFFERED)
+			return IRC_DCC_NO_TRANSFER;
+
+		char path[512];
+		struct stat info;
+		snprintf(path, sizeof(path), "%s/%s", directory, transfer->file);
+
+		// A shorter file of the same name is taken to be an earlier attempt.
+		if (!stat(path, &info) && info.st_size > 0 && static_cast<unsigned long long>(info.st_size) < transfer->size)
+		{
+			transfer->offset = transfer->position = info.st_size;
+			transfer->state = IRC_DCC_RESUMING;
+			transfer->lastActivity = milliseconds();
+
+			char text[512];
+			snprintf(text, sizeof(text), "\x01" "DCC RESUME %s %u %llu\x01", transfer->file, transfer->port, transfer->position);
+			return irc->privmsg(transfer->nick, text);
+		}
+
+		int result = open_output(transfer);
+		if (result == IRC_SUCCESS)
+			result = open_connection(transfer);
+		if (result != IRC_SUCCESS)
+			finish(transfer, IRC_DCC_FAILED);
+		return result;
+	}
+
+	int IRCDcc::cancel(const unsigned int id)
+	{
+		Transfer* transfer = find(id);
+		if (!transfer || transfer->state == IRC_DCC_DONE || transfer->state == IRC_DCC_FAILED)
+			return IRC_DCC_NO_TRANSFER;
+
+		finish(transfer, IRC_DCC_FAILED);
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::stats(const unsigned int id, IRCDccStats* stats) const
+	{
+		const Transfer* transfer = find(id);
+		if (!transfer)
+			return IRC_DCC_NO_TRANSFER;
+
+		fill_stats(transfer, stats);
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::step(const int timeout_ms)
+	{
+		pollfd fds[1 + dccMaxTransfers];
+		unsigned int ids[dccMaxTransfers];
+		unsigned int polled = 0;
+		int timeout = irc->inbound_pending() ? 0 : timeout_ms;
+
+		fds[0].fd = irc->descriptor();
+		fds[0].events = POLLIN;
+
+		for (unsigned int i = 0; i < transferCount; ++i)
+		{
+			Transfer* transfer = transfers[i];
+			if (transfer->state == IRC_DCC_DONE || transfer->state == IRC_DCC_FAILED)
+				continue;
+
+			// Wake up now and then to expire stalled transfers.
+			if (timeout < 0 || timeout > 1000)
+				timeout = 1000;
+
+			if (transfer->sock < 0)
+				continue;
+
+			short events = POLLIN;
+			if (transfer->state == IRC_DCC_CONNECTING)
+				events = POLLOUT;
+			else if (transfer->state == IRC_DCC_TRANSFERRING && transfer->outgoing && transfer->position < transfer->size)
+				events |= POLLOUT;
+
+			fds[1 + polled].fd = transfer->sock;
+			fds[1 + polled].events = events;
+			ids[polled++] = transfer->id;
+		}
+
+		if (poll(fds, 1 + polled, timeout) < 0)
+			return errno == EINTR ? IRC_SUCCESS : IRC_RECV_FAILED;
+
+		// Callbacks may add or finish transfers, so look each one up again.
+		for (unsigned int i = 0; i < polled; ++i)
+		{
+			short revents = fds[1 + i].revents;
+			Transfer* transfer = find(ids[i]);
+			if (!revents || !transfer || transfer->sock != fds[1 + i].fd)
+				continue;
+
+			switch (transfer->state)
+			{
+			case IRC_DCC_LISTENING:
+				accept_peer(transfer);
+				break;
+
+			case IRC_DCC_CONNECTING:
+				{
+					int error = 0;
+					socklen_t length = sizeof(error);
+					if (getsockopt(transfer->sock, SOL_SOCKET, SO_ERROR, &error, &length) || error)
+					{
+						finish(transfer, IRC_DCC_FAILED);
+						break;
+					}
+					transfer->state = IRC_DCC_TRANSFERRING;
+					transfer->started = transfer->lastActivity = milliseconds();
+					if (transfer->position >= transfer->size)
+						finish(transfer, IRC_DCC_DONE);
+				}
+				break;
+
+			case IRC_DCC_TRANSFERRING:
+				if (transfer->outgoing)
+					pump_send(transfer);
+				else
+					pump_recv(transfer);
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		unsigned long long now = milliseconds();
+		for (unsigned int i = 0; i < transferCount; ++i)
+		{
+			Transfer* transfer = transfers[i];
+			if (transfer->state != IRC_DCC_DONE && transfer->state != IRC_DCC_FAILED && now - transfer->lastActivity > dccTimeout)
+				finish(transfer, IRC_DCC_FAILED);
+		}
+
+		if (fds[0].revents)
+			return irc->process_input();
+
+		irc->dispatch_inbound(dccDispatchBatch);
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::run()
+	{
+		if (irc->descriptor() < 0)
+			return IRC_NOT_CONNECTED;
+
+		int result;
+		while ((result = step(-1)) == IRC_SUCCESS);
+
+		return result == IRC_CONNECTION_CLOSED ? IRC_SUCCESS : result;
+	}
+
+	bool IRCDcc::negotiate(const IRCReply* reply)
+	{
+		const char* params = reply->ctcp_params;
+		bool resume = params && !strncmp(params, "RESUME ", 7);
+		if (!resume && !(params && !strncmp(params, "ACCEPT ", 7)))
+			return false;
+
+		// The file name is only echoed back, the port identifies the transfer.
+		const char* p = params + 7;
+		if (*p == '"')
+		{
+			p = strchr(p + 1, '"');
+			if (!p)
+				return true;
+			++p;
+		}
+		else
+			p = strchr(p, ' ');
+
+		unsigned short port;
+		unsigned long long position;
+		if (!p || sscanf(p, " %hu %llu", &port, &position) != 2)
+			return true;
+
+		Transfer* transfer = find_port(resume, port);
+		if (!transfer || !reply->nick || strcmp(transfer->nick, reply->nick))
+			return true;
+
+		if (resume)
+		{
+			if (transfer->state != IRC_DCC_LISTENING || position > transfer->size)
+				return true;
+
+			transfer->offset = transfer->position = position;
+			transfer->lastActivity = milliseconds();
+
+			char text[512];
+			snprintf(text, sizeof(text), "\x01" "DCC ACCEPT %s %u %llu\x01", transfer->file, port, position);
+			irc->privmsg(transfer->nick, text);
+		}
+		else
+		{
+			if (transfer->state != IRC_DCC_RESUMING)
+				return true;
+
+			// The sender may only go back from what was asked for.
+			if (position < transfer->position)
+				transfer->offset = transfer->position = position;
+
+			if (open_output(transfer) != IRC_SUCCESS || open_connection(transfer) != IRC_SUCCESS)
+				finish(transfer, IRC_DCC_FAILED);
+		}
+
+		return true;
+	}
+
+	bool IRCDcc::offer(const IRCReply* reply)
+	{
+		const char* params = reply->ctcp_params;
+		if (!params || strncmp(params, "SEND ", 5) || !reply->nick)
+			return false;
+
+		char name[256];
+		const char* start = params + 5;
+		const char* end;
+		const char* p;
+		if (*start == '"')
+		{
+			end = strchr(++start, '"');
+			p = end ? end + 1 : NULL;
+		}
+		else
+			p = end = strchr(start, ' ');
+		if (!end)
+			return false;
+
+		unsigned int length = __IRC_MIN__(static_cast<unsigned int>(end - start), sizeof(name) - 1);
+		memcpy(name, start, length);
+		name[length] = '\0';
+
+		unsigned int peer;
+		unsigned int port;
+		unsigned long long size;
+		// Port 0 is a passive offer, which isn't supported.
+		if (sscanf(p, " %u %u %llu", &peer, &port, &size) != 3 || !port || port > 65535)
+			return false;
+
+		// Never let the sender pick the directory.
+		const char* file = name;
+		for (const char* c = name; *c; ++c)
+			if (*c == '/' || *c == '\\')
+				file = c + 1;
+		if (!*file || *file == '.')
+			return true;
+
+		Transfer* transfer = add(reply->nick, file, false);
+		if (!transfer)
+			return true;
+		transfer->peerAddress = peer;
+		transfer->port = port;
+		transfer->size = size;
+
+		if (callback)
+		{
+			IRCDccStats stats;
+			fill_stats(transfer, &stats);
+			callback(this, &stats);
+		}
+
+		return true;
+	}
+
+	IRCDcc::Transfer* IRCDcc::find(const unsigned int id) const
+	{
+		for (unsigned int i = 0; i < transferCount; ++i)
+			if (transfers[i]->id == id)
+				return transfers[i];
+		return NULL;
+	}
+
+	IRCDcc::Transfer* IRCDcc::find_port(const bool outgoing, const unsigned short port) const
+	{
+		for (unsigned int i = 0; i < transferCount; ++i)
+			if (transfers[i]->outgoing == outgoing && transfers[i]->port == port && transfers[i]->state != IRC_DCC_DONE && transfers[i]->state != IRC_DCC_FAILED)
+				return transfers[i];
+		return NULL;
+	}
+
+	IRCDcc::Transfer* IRCDcc::add(const char* nick, const char* file, const bool outgoing)
+	{
+		if (transferCount == dccMaxTransfers)
+		{
+			// Make room by forgetting the oldest finished transfer.
+			unsigned int oldest = dccMaxTransfers;
+			for (unsigned int i = 0; i < transferCount; ++i)
+				if ((transfers[i]->state == IRC_DCC_DONE || transfers[i]->state == IRC_DCC_FAILED) && (oldest == dccMaxTransfers || transfers[i]->finished < transfers[oldest]->finished))
+					oldest = i;
+			if (oldest == dccMaxTransfers)
+				return NULL;
+			remove(oldest);
+		}
+
+		Transfer* transfer = irc_new<Transfer>();
+		memset(transfer, 0, sizeof(Transfer));
+		transfer->id = nextId++;
+		transfer->outgoing = outgoing;
+		transfer->state = outgoing ? IRC_DCC_LISTENING : IRC_DCC_OFFERED;
+		snprintf(transfer->nick, sizeof(transfer->nick), "%s", nick);
+		snprintf(transfer->file, sizeof(transfer->file), "%s", file);
+		transfer->fd = -1;
+		transfer->sock = -1;
+		transfer->created = transfer->lastActivity = milliseconds();
+
+		transfers[transferCount++] = transfer;
+		return transfer;
+	}
+
+	void IRCDcc::remove(const unsigned int index)
+	{
+		irc_delete(transfers[index]);
+		transfers[index] = transfers[--transferCount];
+	}
+
+	int IRCDcc::open_listener(Transfer* transfer)
+	{
+		sockaddr_in local;
+		socklen_t length = sizeof(local);
+
+		transfer->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (transfer->sock < 0)
+			return IRC_SOCKET_CREATION_FAILED;
+
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		local.sin_port = 0;
+
+		if (bind(transfer->sock, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) || ::listen(transfer->sock, 1) ||
+			getsockname(transfer->sock, reinterpret_cast<sockaddr*>(&local), &length))
+			return IRC_SOCKET_CONNECT_FAILED;
+
+		set_nonblocking(transfer->sock);
+		transfer->port = ntohs(local.sin_port);
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::open_connection(Transfer* transfer)
+	{
+		sockaddr_in peer;
+
+		transfer->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (transfer->sock < 0)
+			return IRC_SOCKET_CREATION_FAILED;
+		set_nonblocking(transfer->sock);
+
+		memset(&peer, 0, sizeof(peer));
+		peer.sin_family = AF_INET;
+		peer.sin_addr.s_addr = htonl(transfer->peerAddress);
+		peer.sin_port = htons(transfer->port);
+
+		if (::connect(transfer->sock, reinterpret_cast<const sockaddr*>(&peer), sizeof(peer)) && errno != EINPROGRESS)
+			return IRC_SOCKET_CONNECT_FAILED;
+
+		transfer->state = IRC_DCC_CONNECTING;
+		transfer->lastActivity = milliseconds();
+		return IRC_SUCCESS;
+	}
+
+	int IRCDcc::open_output(Transfer* transfer)
+	{
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%s", directory, transfer->file);
+
+		transfer->fd = open(path, O_WRONLY | O_CREAT | (transfer->position ? 0 : O_TRUNC), 0644);
+		if (transfer->fd < 0)
+			return IRC_DCC_FILE_FAILED;
+
+#ifdef __linux__
+		// Reserve the blocks without changing the file size, which is
+		// what a later RESUME goes by.
+		fallocate(transfer->fd, FALLOC_FL_KEEP_SIZE, 0, transfer->size);
+#endif
+
+		if (lseek(transfer->fd, transfer->position, SEEK_SET) < 0)
+			return IRC_DCC_FILE_FAILED;
+
+		return IRC_SUCCESS;
+	}
+
+	void IRCDcc::accept_peer(Transfer* transfer)
+	{
+		int sock = ::accept(transfer->sock, NULL, NULL);
+		if (sock < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				finish(transfer, IRC_DCC_FAILED);
+			return;
+		}
+
+		// One peer per offer.
+		closesocket(transfer->sock);
+		set_nonblocking(sock);
+		transfer->sock = sock;
+		transfer->state = IRC_DCC_TRANSFERRING;
+		transfer->started = transfer->lastActivity = milliseconds();
+
+		pump_send(transfer);
+	}
+
+	void IRCDcc::pump_send(Transfer* transfer)
+	{
+		unsigned char buffer[256];
+
+		// Drain acknowledgements first, the last complete one counts.
+		while (1)
+		{
+			int length = recv(transfer->sock, buffer, sizeof(buffer), 0);
+			if (!length)
+			{
+				// Receivers are allowed to just hang up once they have everything.
+				finish(transfer, transfer->position == transfer->size ? IRC_DCC_DONE : IRC_DCC_FAILED);
+				return;
+			}
+			if (length < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				{
+					finish(transfer, IRC_DCC_FAILED);
+					return;
+				}
+				break;
+			}
+
+			for (int i = 0; i < length; ++i)
+			{
+				transfer->ack[transfer->ackLength++] = buffer[i];
+				if (transfer->ackLength == 4)
+				{
+					transfer->acked = (transfer->ack[0] << 24) | (transfer->ack[1] << 16) | (transfer->ack[2] << 8) | transfer->ack[3];
+					transfer->ackLength = 0;
+				}
+			}
+			transfer->lastActivity = milliseconds();
+		}
+
+		while (transfer->position < transfer->size)
+		{
+			off_t offset = transfer->position;
+			ssize_t sent = sendfile(transfer->sock, transfer->fd, &offset, __IRC_MIN__(transfer->size - transfer->position, dccSendChunk));
+			if (sent <= 0)
+			{
+				if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					finish(transfer, IRC_DCC_FAILED);
+				// A file that shrank under us can't be finished either.
+				else if (!sent)
+					finish(transfer, IRC_DCC_FAILED);
+				return;
+			}
+
+			transfer->position += sent;
+			transfer->lastActivity = milliseconds();
+		}
+
+		if (transfer->acked == static_cast<unsigned int>(transfer->size))
+			finish(transfer, IRC_DCC_DONE);
+	}
+
+	void IRCDcc::pump_recv(Transfer* transfer)
+	{
+		char buffer[65536];
+
+		// Bounded so one fast transfer can't hold up the others.
+		for (int round = 0; round < 16 && transfer->position < transfer->size; ++round)
+		{
+			int length = recv(transfer->sock, buffer, static_cast<int>(__IRC_MIN__(transfer->size - transfer->position, sizeof(buffer))), 0);
+			if (!length)
+			{
+				finish(transfer, IRC_DCC_FAILED);
+				return;
+			}
+			if (length < 0)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+					finish(transfer, IRC_DCC_FAILED);
+				return;
+			}
+
+			for (int written = 0; written < length;)
+			{
+				ssize_t result = write(transfer->fd, buffer + written, length - written);
+				if (result < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					finish(transfer, IRC_DCC_FAILED);
+					return;
+				}
+				written += result;
+			}
+
+			transfer->position += length;
+			transfer->lastActivity = milliseconds();
+
+			unsigned int ack = htonl(static_cast<unsigned int>(transfer->position));
+			send(transfer->sock, reinterpret_cast<const char*>(&ack), sizeof(ack), MSG_NOSIGNAL);
+		}
+
+		if (transfer->position >= transfer->size)
+			finish(transfer, IRC_DCC_DONE);
+	}
+
+	void IRCDcc::finish(Transfer* transfer, const IRCDccState state)
+	{
+		if (transfer->sock >= 0)
+			closesocket(transfer->sock);
+		if (transfer->fd >= 0)
+			::close(transfer->fd);
+		transfer->sock = -1;
+		transfer->fd = -1;
+		transfer->state = state;
+		transfer->finished = milliseconds();
+
+		if (prnt)
+			prnt("[cpIRC]: DCC %s %s %s: %llu of %llu bytes\n", transfer->outgoing ? "to" : "from", transfer->nick, state == IRC_DCC_DONE ? "done" : "failed", transfer->position, transfer->size);
+
+		if (callback)
+		{
+			IRCDccStats stats;
+			fill_stats(transfer, &stats);
+			callback(this, &stats);
+		}
+	}
+
+	void IRCDcc::fill_stats(const Transfer* transfer, IRCDccStats* stats) const
+	{
+		stats->id = transfer->id;
+		stats->outgoing = transfer->outgoing;
+		stats->state = transfer->state;
+		memcpy(stats->nick, transfer->nick, sizeof(stats->nick));
+		memcpy(stats->file, transfer->file, sizeof(stats->file));
+		stats->size = transfer->size;
+		stats->position = transfer->position;
+		stats->offset = transfer->offset;
+
+		if (transfer->started)
+		{
+			unsigned long long end = transfer->finished ? transfer->finished : milliseconds();
+			stats->elapsed_ms = end - transfer->started;
+			stats->rate = stats->elapsed_ms ? (transfer->position - transfer->offset) * 1000 / stats->elapsed_ms : 0;
+		}
+		else
+		{
+			stats->elapsed_ms = 0;
+			stats->rate = 0;
+		}
+	}
+
+#else
+
+	IRCDcc::IRCDcc(IRC* irc, void(*printFunction)(const char* fmt, ...))
+	{
+		this->irc = irc;
+		prnt = printFunction;
+		transfers = NULL;
+		transferCount = 0;
+	}
+
+	IRCDcc::~IRCDcc()
+	{
+	}
+
+	void IRCDcc::set_directory(const char*)
+	{
+	}
+
+	void IRCDcc::set_address(const unsigned int)
+	{
+	}
+
+	void IRCDcc::set_callback(IRCDccCallback)
+	{
+	}
+
+	int IRCDcc::send_file(const char*, const char*, unsigned int*)
+	{
+		return IRC_SOCKET_CREATION_FAILED;
+	}
+
+	int IRCDcc::accept(const unsigned int)
+	{
+		return IRC_DCC_NO_TRANSFER;
+	}
+
+	int IRCDcc::cancel(const unsigned int)
+	{
+		return IRC_DCC_NO_TRANSFER;
+	}
+
+	int IRCDcc::stats(const unsigned int, IRCDccStats*) const
+	{
+		return IRC_DCC_NO_TRANSFER;
+	}
+
+	int IRCDcc::step(const int)
+	{
+		return IRC_NOT_CONNECTED;
+	}
+
+	int IRCDcc::run()
+	{
+		return IRC_NOT_CONNECTED;
+	}
+
+	bool IRCDcc::negotiate(const IRCReply*)
+	{
+		return false;
+	}
+
+	bool IRCDcc::offer(const IRCReply*)
+	{
+		return false;
+	}
+
+#endif
+}
@@ -0,0 +1,130 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// DCC SEND file transfers, negotiated over CTCP.
+//
+// send_file() offers a file and streams it with sendfile() once the peer
+// connects, so outgoing data never passes through user space. Incoming
+// files are preallocated to their full size before the first byte
+// arrives. A partial copy already on disk is continued with DCC
+// RESUME/ACCEPT. step() polls the IRC connection and every transfer
+// together, so one thread drives any number of them. POSIX only.
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	enum IRCDccState
+	{
+		IRC_DCC_OFFERED = 0,	// Incoming, waiting for accept().
+		IRC_DCC_RESUMING,		// Incoming, waiting for the sender's ACCEPT.
+		IRC_DCC_LISTENING,		// Outgoing, waiting for the peer to connect.
+		IRC_DCC_CONNECTING,
+		IRC_DCC_TRANSFERRING,
+		IRC_DCC_DONE,
+		IRC_DCC_FAILED
+	};
+
+	struct IRCDccStats
+	{
+		unsigned int id;
+		bool outgoing;
+		IRCDccState state;
+		char nick[64];
+		char file[256];
+		unsigned long long size;
+		unsigned long long position;
+		// Where this session started, non-zero after a resume.
+		unsigned long long offset;
+		unsigned long long elapsed_ms;
+		// Bytes per second since the connection came up.
+		unsigned long long rate;
+	};
+
+	class IRCDcc;
+
+	// Called when an offer arrives and when a transfer finishes or fails.
+	typedef IRCDelegate<int(IRCDcc*, const IRCDccStats*)> IRCDccCallback;
+
+	class IRCDcc
+	{
+	public:
+		IRCDcc(IRC* irc, void(*printFunction)(const char* fmt, ...));
+		~IRCDcc();
+
+		// Where incoming files are written, the current directory by default.
+		void set_directory(const char* path);
+		// Address put in outgoing offers, host byte order. Defaults to loopback.
+		void set_address(const unsigned int address);
+		void set_callback(IRCDccCallback function);
+
+		int send_file(const char* nick, const char* path, unsigned int* id);
+		int accept(const unsigned int id);
+		int cancel(const unsigned int id);
+		int stats(const unsigned int id, IRCDccStats* stats) const;
+
+		// One poll over the IRC connection and all transfers.
+		int step(const int timeout_ms);
+		// Calls step() until the IRC connection closes.
+		int run();
+
+		// Called by IRC for DCC requests. negotiate() takes RESUME and
+		// ACCEPT and is reached before the CTCP flood limits, offer()
+		// takes SEND.
+		bool negotiate(const IRCReply* reply);
+		bool offer(const IRCReply* reply);
+
+	private:
+		IRCDcc(const IRCDcc&);
+		IRCDcc& operator=(const IRCDcc&);
+
+		struct Transfer;
+
+		Transfer* find(const unsigned int id) const;
+		Transfer* find_port(const bool outgoing, const unsigned short port) const;
+		Transfer* add(const char* nick, const char* file, const bool outgoing);
+		void remove(const unsigned int index);
+
+		int open_listener(Transfer* transfer);
+		int open_connection(Transfer* transfer);
+		int open_output(Transfer* transfer);
+		void accept_peer(Transfer* transfer);
+		void pump_send(Transfer* transfer);
+		void pump_recv(Transfer* transfer);
+		void finish(Transfer* transfer, const IRCDccState state);
+		void fill_stats(const Transfer* transfer, IRCDccStats* stats) const;
+
+		IRC* irc;
+		void(*prnt)(const char* format, ...);
+		IRCDccCallback callback;
+		char directory[256];
+		unsigned int address;
+		unsigned int nextId;
+
+		Transfer** transfers;
+		unsigned int transferCount;
+	};
+}
@@ -0,0 +1,175 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Type-erased callable with inline storage.
+//
+// Holds a plain function pointer or any functor (lambdas with captures
+// included) of up to four pointers in size, without touching the heap.
+// Calling it costs one indirect call. Bigger functors fail to compile;
+// capture a pointer to your state instead.
+
+#include <cstddef>
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+namespace cpIRC
+{
+	template<typename Signature>
+	class IRCDelegate;
+
+	template<typename R, typename... Args>
+	class IRCDelegate<R(Args...)>
+	{
+		// Only callables with a matching signature are taken by the template
+		// constructor, so NULL falls through to the nullptr_t one.
+		template<typename F, typename = void>
+		struct Callable : std::false_type
+		{
+		};
+
+		template<typename F>
+		struct Callable<F, typename std::enable_if<!std::is_same<typename std::decay<F>::type, IRCDelegate>::value &&
+			(std::is_void<R>::value || std::is_convertible<decltype(std::declval<typename std::decay<F>::type&>()(std::declval<Args>()...)), R>::value)>::type> : std::true_type
+		{
+		};
+
+	public:
+		IRCDelegate() : invoker(NULL), manager(NULL)
+		{
+		}
+
+		// NULL and nullptr both leave the delegate empty.
+		IRCDelegate(std::nullptr_t) : invoker(NULL), manager(NULL)
+		{
+		}
+
+		// Function pointers come through here too, a NULL one leaves the
+		// delegate empty.
+		template<typename F, typename = typename std::enable_if<Callable<F>::value>::type>
+		IRCDelegate(F&& functor) : invoker(NULL), manager(NULL)
+		{
+			if (!is_null(functor))
+				store(static_cast<F&&>(functor));
+		}
+
+		IRCDelegate(const IRCDelegate& other) : invoker(other.invoker), manager(other.manager)
+		{
+			if (manager)
+				manager(&storage, &other.storage);
+			else
+				storage = other.storage;
+		}
+
+		IRCDelegate& operator=(const IRCDelegate& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				invoker = other.invoker;
+				manager = other.manager;
+				if (manager)
+					manager(&storage, &other.storage);
+				else
+					storage = other.storage;
+			}
+			return *this;
+		}
+
+		~IRCDelegate()
+		{
+			reset();
+		}
+
+		R operator()(Args... args) const
+		{
+			return invoker(const_cast<Storage*>(&storage), args...);
+		}
+
+		explicit operator bool() const
+		{
+			return invoker != NULL;
+		}
+
+		void reset()
+		{
+			if (manager)
+				manager(&storage, NULL);
+			invoker = NULL;
+			manager = NULL;
+		}
+
+	private:
+		typedef typename std::aligned_storage<4 * sizeof(void*), alignof(void*)>::type Storage;
+		typedef R(*Invoker)(void*, Args...);
+		// Copy-constructs from source, or destroys when source is NULL.
+		typedef void(*Manager)(void*, const void*);
+
+		template<typename F>
+		static bool is_null(const F&)
+		{
+			return false;
+		}
+
+		static bool is_null(R(*function)(Args...))
+		{
+			return !function;
+		}
+
+		template<typename F>
+		static R invoke(void* object, Args... args)
+		{
+			return (*static_cast<F*>(object))(args...);
+		}
+
+		template<typename F>
+		static void manage(void* object, const void* source)
+		{
+			if (source)
+				new (object) F(*static_cast<const F*>(source));
+			else
+				static_cast<F*>(object)->~F();
+		}
+
+		template<typename T>
+		void store(T&& functor)
+		{
+			typedef typename std::decay<T>::type F;
+			static_assert(sizeof(F) <= sizeof(Storage), "IRCDelegate: functor too large for inline storage");
+			static_assert(alignof(F) <= alignof(Storage), "IRCDelegate: functor over-aligned for inline storage");
+
+			new (&storage) F(static_cast<T&&>(functor));
+			invoker = &invoke<F>;
+			// Trivially copyable functors are copied bitwise and need no cleanup.
+			manager = std::is_trivially_copyable<F>::value ? NULL : &manage<F>;
+		}
+
+		Storage storage;
+		Invoker invoker;
+		Manager manager;
+	};
+}
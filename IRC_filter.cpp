@@ -0,0 +1,387 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include <atomic>
+
+#include "IRC_filter.hpp"
+
+namespace cpIRC
+{
+	static unsigned int append(char* dest, unsigned int length, const unsigned int destLen, const char* src)
+	{
+		while (*src && length < destLen - 1)
+			dest[length++] = *src++;
+		dest[length] = '\0';
+		return length;
+	}
+
+	IRCFilterSet::IRCFilterSet()
+	{
+		compiled = false;
+		classCount = 0;
+		fallbackMasks = -1;
+		memset(classes, 0, sizeof(classes));
+	}
+
+	IRCFilterSet::~IRCFilterSet()
+	{
+	}
+
+	void IRCFilterSet::add_keyword(const char* keyword, int rule)
+	{
+		if (!keyword || !*keyword)
+			return;
+
+		Pattern pattern;
+		while (*keyword)
+			pattern.text.push_back(static_cast<char>(tolower(static_cast<unsigned char>(*keyword++))));
+		pattern.text.push_back('\0');
+		pattern.rule = rule;
+
+		keywords.push_back(pattern);
+		compiled = false;
+	}
+
+	void IRCFilterSet::add_mask(const char* mask, int rule)
+	{
+		if (!mask || !*mask)
+			return;
+
+		Mask entry;
+		while (*mask)
+			entry.pattern.push_back(static_cast<char>(tolower(static_cast<unsigned char>(*mask++))));
+		entry.pattern.push_back('\0');
+		entry.prefix = 0;
+		entry.rule = rule;
+		entry.next = -1;
+
+		masks.push_back(entry);
+		compiled = false;
+	}
+
+	void IRCFilterSet::compile()
+	{
+		if (compiled)
+			return;
+
+		compile_keywords();
+		compile_masks();
+		compiled = true;
+	}
+
+	int IRCFilterSet::match_text(const char* text) const
+	{
+		if (!compiled || transitions.empty() || !text)
+			return -1;
+
+		const int* table = &transitions[0];
+		int best = -1;
+		int row = 0;
+
+		for (const unsigned char* p = reinterpret_cast<const unsigned char*>(text); *p; ++p)
+		{
+			row = table[row + classes[*p]];
+			if (row < 0) // Complemented: the state emits a rule.
+			{
+				row = ~row;
+				int rule = outputs[row / classCount];
+				if (best < 0 || rule < best)
+					best = rule;
+			}
+		}
+
+		return best;
+	}
+
+	int IRCFilterSet::match_source(const char* source) const
+	{
+		if (!compiled || masks.empty() || !source)
+			return -1;
+
+		char subject[512];
+		unsigned int length = 0;
+		while (source[length] && length < sizeof(subject) - 1)
+		{
+			subject[length] = static_cast<char>(tolower(static_cast<unsigned char>(source[length])));
+			++length;
+		}
+		subject[length] = '\0';
+
+		int best = -1;
+
+		for (int m = fallbackMasks; m >= 0; m = masks[m].next)
+		{
+			if (best >= 0 && masks[m].rule >= best)
+				continue;
+			if (glob_match(&masks[m].pattern[0], subject))
+				best = masks[m].rule;
+		}
+
+		int node = 0;
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			int child = maskNodes[node].child;
+			while (child >= 0 && maskNodes[child].ch != static_cast<unsigned char>(subject[i]))
+				child = maskNodes[child].sibling;
+			if (child < 0)
+				break;
+			node = child;
+
+			for (int m = maskNodes[node].masks; m >= 0; m = masks[m].next)
+			{
+				if (best >= 0 && masks[m].rule >= best)
+					continue;
+				if (glob_match(&masks[m].pattern[masks[m].prefix], subject + i + 1))
+					best = masks[m].rule;
+			}
+		}
+
+		return best;
+	}
+
+	void IRCFilterSet::compile_keywords()
+	{
+		memset(classes, 0, sizeof(classes));
+		classCount = 1; // Class 0 is every byte that appears in no keyword.
+		transitions.clear();
+		outputs.clear();
+
+		if (keywords.empty())
+			return;
+
+		for (unsigned int k = 0; k < keywords.size(); ++k)
+			for (const char* p = &keywords[k].text[0]; *p; ++p)
+				if (!classes[static_cast<unsigned char>(*p)])
+					classes[static_cast<unsigned char>(*p)] = static_cast<unsigned char>(classCount++);
+
+		for (int c = 'A'; c <= 'Z'; ++c)
+			classes[c] = classes[c - 'A' + 'a'];
+
+		// Trie first. Zero means "no edge", the root is never a child.
+		transitions.assign(classCount, 0);
+		outputs.assign(1, -1);
+
+		for (unsigned int k = 0; k < keywords.size(); ++k)
+		{
+			int state = 0;
+			for (const char* p = &keywords[k].text[0]; *p; ++p)
+			{
+				int cls = classes[static_cast<unsigned char>(*p)];
+				int next = transitions[state * classCount + cls];
+				if (!next)
+				{
+					next = static_cast<int>(outputs.size());
+					transitions.resize(transitions.size() + classCount, 0);
+					outputs.push_back(-1);
+					transitions[state * classCount + cls] = next;
+				}
+				state = next;
+			}
+
+			if (outputs[state] < 0 || keywords[k].rule < outputs[state])
+				outputs[state] = keywords[k].rule;
+		}
+
+		// Failure links in BFS order, folded straight into a full DFA.
+		std::vector<int, IRCStdAllocator<int> > fail(outputs.size(), 0);
+		std::vector<int, IRCStdAllocator<int> > queue;
+		queue.reserve(outputs.size());
+
+		for (int c = 0; c < classCount; ++c)
+			if (transitions[c])
+				queue.push_back(transitions[c]);
+
+		for (unsigned int head = 0; head < queue.size(); ++head)
+		{
+			int state = queue[head];
+			for (int c = 0; c < classCount; ++c)
+			{
+				int next = transitions[state * classCount + c];
+				int fallback = transitions[fail[state] * classCount + c];
+				if (!next)
+				{
+					transitions[state * classCount + c] = fallback;
+					continue;
+				}
+
+				fail[next] = fallback;
+				if (outputs[fallback] >= 0 && (outputs[next] < 0 || outputs[fallback] < outputs[next]))
+					outputs[next] = outputs[fallback];
+				queue.push_back(next);
+			}
+		}
+
+		// Store row offsets instead of state numbers so matching skips the
+		// multiply, complemented when the target state emits a rule.
+		for (unsigned int i = 0; i < transitions.size(); ++i)
+		{
+			int state = transitions[i];
+			transitions[i] = outputs[state] >= 0 ? ~(state * classCount) : state * classCount;
+		}
+	}
+
+	void IRCFilterSet::compile_masks()
+	{
+		MaskNode root = { 0, -1, -1, -1 };
+		maskNodes.assign(1, root);
+		fallbackMasks = -1;
+
+		// Insert back to front so each list keeps the order masks were added in.
+		for (int m = static_cast<int>(masks.size()) - 1; m >= 0; --m)
+		{
+			const char* pattern = &masks[m].pattern[0];
+			int node = 0;
+			int prefix = 0;
+
+			while (pattern[prefix] && pattern[prefix] != '*' && pattern[prefix] != '?')
+			{
+				unsigned char ch = static_cast<unsigned char>(pattern[prefix]);
+				int child = maskNodes[node].child;
+				while (child >= 0 && maskNodes[child].ch != ch)
+					child = maskNodes[child].sibling;
+
+				if (child < 0)
+				{
+					MaskNode entry = { ch, -1, maskNodes[node].child, -1 };
+					child = static_cast<int>(maskNodes.size());
+					maskNodes.push_back(entry);
+					maskNodes[node].child = child;
+				}
+
+				node = child;
+				++prefix;
+			}
+
+			masks[m].prefix = prefix;
+			if (!prefix)
+			{
+				masks[m].next = fallbackMasks;
+				fallbackMasks = m;
+			}
+			else
+			{
+				masks[m].next = maskNodes[node].masks;
+				maskNodes[node].masks = m;
+			}
+		}
+	}
+
+	bool IRCFilterSet::glob_match(const char* pattern, const char* subject)
+	{
+		const char* star = NULL;
+		const char* resume = NULL;
+
+		while (*subject)
+		{
+			if (*pattern == '*')
+			{
+				star = ++pattern;
+				resume = subject;
+			}
+			else if (*pattern == '?' || *pattern == *subject)
+			{
+				++pattern;
+				++subject;
+			}
+			else if (star)
+			{
+				pattern = star;
+				subject = ++resume;
+			}
+			else
+				return false;
+		}
+
+		while (*pattern == '*')
+			++pattern;
+
+		return !*pattern;
+	}
+
+	IRCFilter::IRCFilter()
+	{
+	}
+
+	IRCFilter::~IRCFilter()
+	{
+	}
+
+	void IRCFilter::publish(IRCFilterSet* set)
+	{
+		if (set)
+			set->compile();
+
+		std::shared_ptr<const IRCFilterSet> next(set, &irc_delete<IRCFilterSet>, IRCStdAllocator<IRCFilterSet>());
+		std::atomic_store(&current, next);
+	}
+
+	void IRCFilter::clear()
+	{
+		publish(NULL);
+	}
+
+	int IRCFilter::match(const IRCReply* reply) const
+	{
+		std::shared_ptr<const IRCFilterSet> set = std::atomic_load(&current);
+		if (!set || !reply)
+			return -1;
+
+		int best = -1;
+
+		if (reply->nick)
+		{
+			char source[512];
+			unsigned int length = append(source, 0, sizeof(source), reply->nick);
+			if (reply->user && reply->host)
+			{
+				length = append(source, length, sizeof(source), "!");
+				length = append(source, length, sizeof(source), reply->user);
+				length = append(source, length, sizeof(source), "@");
+				length = append(source, length, sizeof(source), reply->host);
+			}
+			best = set->match_source(source);
+		}
+
+		const char* text = reply->params;
+		if (text)
+		{
+			const char* trailing = strstr(text, " :");
+			if (trailing)
+				text = trailing + 2;
+			else if (*text == ':')
+				++text;
+			else if (strchr(text, ' '))
+				text = strchr(text, ' ') + 1;
+
+			int rule = set->match_text(text);
+			if (rule >= 0 && (best < 0 || rule < best))
+				best = rule;
+		}
+
+		return best;
+	}
+}
@@ -0,0 +1,122 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Keyword and hostmask matching for PRIVMSG filtering.
+//
+// Rules are collected into an IRCFilterSet and compiled once: keywords into
+// an Aho-Corasick automaton, masks into a literal-prefix trie with a
+// fallback list for masks that begin with a wildcard. A compiled set is
+// immutable; IRCFilter::publish() swaps it in atomically, and readers keep
+// the snapshot they started with until they are done (RCU style).
+
+#include <memory>
+#include <vector>
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	class IRCFilterSet
+	{
+	public:
+		IRCFilterSet();
+		~IRCFilterSet();
+
+		// Rule ids are chosen by the caller, lower ids win.
+		void add_keyword(const char* keyword, int rule);
+		void add_mask(const char* mask, int rule);
+		void compile();
+
+		// Both return the lowest matching rule id, or -1.
+		int match_text(const char* text) const;
+		int match_source(const char* source) const;
+
+	private:
+		IRCFilterSet(const IRCFilterSet&);
+		IRCFilterSet& operator=(const IRCFilterSet&);
+
+		struct Pattern
+		{
+			std::vector<char, IRCStdAllocator<char> > text;
+			int rule;
+		};
+
+		struct MaskNode
+		{
+			unsigned char ch;
+			int child;
+			int sibling;
+			int masks;
+		};
+
+		struct Mask
+		{
+			std::vector<char, IRCStdAllocator<char> > pattern;
+			int prefix;
+			int rule;
+			int next;
+		};
+
+		void compile_keywords();
+		void compile_masks();
+		static bool glob_match(const char* pattern, const char* subject);
+
+		bool compiled;
+		std::vector<Pattern, IRCStdAllocator<Pattern> > keywords;
+
+		// Aho-Corasick DFA over a compacted alphabet.
+		unsigned char classes[256];
+		int classCount;
+		std::vector<int, IRCStdAllocator<int> > transitions;
+		std::vector<int, IRCStdAllocator<int> > outputs;
+
+		// Literal-prefix trie, node 0 is the root.
+		std::vector<MaskNode, IRCStdAllocator<MaskNode> > maskNodes;
+		std::vector<Mask, IRCStdAllocator<Mask> > masks;
+		int fallbackMasks;
+	};
+
+	class IRCFilter
+	{
+	public:
+		IRCFilter();
+		~IRCFilter();
+
+		// Takes ownership, compiles the set if needed and swaps it in. The
+		// set must come from irc_new(), it is freed with irc_delete().
+		void publish(IRCFilterSet* set);
+		void clear();
+
+		// Checks "nick!user@host" and the message text of a reply.
+		int match(const IRCReply* reply) const;
+
+	private:
+		IRCFilter(const IRCFilter&);
+		IRCFilter& operator=(const IRCFilter&);
+
+		std::shared_ptr<const IRCFilterSet> current;
+	};
+}
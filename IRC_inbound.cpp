@@ -0,0 +1,310 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <ctype.h>
+
+#include "IRC_inbound.hpp"
+
+namespace cpIRC
+{
+	// The parts of a raw line the queue looks at, pointing into the line.
+	struct RawLine
+	{
+		const char* nick;
+		unsigned int nickLength;
+		const char* command;
+		unsigned int commandLength;
+		const char* params;
+	};
+
+	static void split_line(const char* line, RawLine* raw)
+	{
+		memset(raw, 0, sizeof(RawLine));
+
+		const char* p = line;
+		if (*p == ':')
+		{
+			raw->nick = ++p;
+			while (*p && *p != ' ' && *p != '!' && *p != '@')
+				++p;
+			raw->nickLength = p - raw->nick;
+			p = strchr(p, ' ');
+			if (!p)
+				return;
+			++p;
+		}
+
+		raw->command = p;
+		while (*p && *p != ' ')
+			++p;
+		raw->commandLength = p - raw->command;
+		raw->params = *p ? p + 1 : p;
+	}
+
+	static bool is_command(const RawLine* raw, const char* command)
+	{
+		return raw->command && raw->commandLength == strlen(command) && !strncmp(raw->command, command, raw->commandLength);
+	}
+
+	// First channel of a JOIN or PART, which may be a trailing parameter.
+	static unsigned int first_channel(const char* params, const char** channel)
+	{
+		if (*params == ':')
+			++params;
+		*channel = params;
+		unsigned int length = 0;
+		while (params[length] && params[length] != ' ' && params[length] != ',')
+			++length;
+		return length;
+	}
+
+	static unsigned int nick_hash(const char* nick, unsigned int length)
+	{
+		unsigned int hash = 2166136261u;
+		for (; length--; ++nick)
+		{
+			unsigned char ch = *nick;
+			if (ch >= 'A' && ch <= 'Z')
+				ch += 'a' - 'A';
+			hash = (hash ^ ch) * 16777619u;
+		}
+		return hash;
+	}
+
+	IRCInboundQueue::IRCInboundQueue()
+	{
+		ruleCount = 0;
+		slots = NULL;
+		capacity = 0;
+		head = 0;
+		count = 0;
+		live = 0;
+		memset(&counters, 0, sizeof(counters));
+
+		set_policy("PING", IRC_INBOUND_INLINE);
+		set_policy("ERROR", IRC_INBOUND_KEEP);
+		set_policy("KICK", IRC_INBOUND_KEEP);
+		set_policy("JOIN", IRC_INBOUND_BULK);
+		set_policy("PART", IRC_INBOUND_BULK);
+		set_policy("QUIT", IRC_INBOUND_BULK);
+	}
+
+	IRCInboundQueue::~IRCInboundQueue()
+	{
+		set_capacity(0);
+	}
+
+	void IRCInboundQueue::set_capacity(const unsigned int lines)
+	{
+		if (slots)
+			irc_delete_array(slots, capacity);
+
+		slots = lines ? irc_new_array<Slot>(lines) : NULL;
+		capacity = lines;
+		head = 0;
+		count = 0;
+		live = 0;
+	}
+
+	bool IRCInboundQueue::enabled() const
+	{
+		return capacity != 0;
+	}
+
+	void IRCInboundQueue::set_policy(const char* command, const IRCInboundPolicy policy)
+	{
+		if (strlen(command) >= sizeof(rules[0].command))
+			return;
+
+		for (unsigned int i = 0; i < ruleCount; ++i)
+		{
+			if (!strcmp(rules[i].command, command))
+			{
+				rules[i].policy = policy;
+				return;
+			}
+		}
+
+		if (ruleCount == sizeof(rules) / sizeof(rules[0]))
+			return;
+
+		strcpy(rules[ruleCount].command, command);
+		rules[ruleCount].policy = policy;
+		++ruleCount;
+	}
+
+	IRCInboundPolicy IRCInboundQueue::classify(const char* line) const
+	{
+		RawLine raw;
+		split_line(line, &raw);
+		if (!raw.command)
+			return IRC_INBOUND_NORMAL;
+
+		for (unsigned int i = 0; i < ruleCount; ++i)
+			if (is_command(&raw, rules[i].command))
+				return rules[i].policy;
+
+		// Numerics are replies to something we asked for.
+		if (raw.commandLength == 3 && isdigit(raw.command[0]) && isdigit(raw.command[1]) && isdigit(raw.command[2]))
+			return IRC_INBOUND_KEEP;
+
+		return IRC_INBOUND_NORMAL;
+	}
+
+	bool IRCInboundQueue::push(const char* line, const unsigned int length, const IRCInboundPolicy policy)
+	{
+		if (policy == IRC_INBOUND_DROP)
+		{
+			++counters.shed[policy];
+			return false;
+		}
+
+		unsigned int limit = capacity;
+		if (policy == IRC_INBOUND_NORMAL)
+			limit = capacity - capacity / 8;
+		else if (policy == IRC_INBOUND_BULK)
+			limit = capacity / 2;
+
+		// Withdrawn JOINs don't count against the limit.
+		if (live >= limit)
+		{
+			if (policy == IRC_INBOUND_BULK)
+				withdraw_joins(line);
+			++counters.shed[policy];
+			return false;
+		}
+
+		// Live lines are under the limit, so a full ring holds some withdrawn ones.
+		if (count == capacity)
+			compact();
+
+		Slot* slot = &slots[(head + count) % capacity];
+		slot->length = __IRC_MIN__(length, sizeof(slot->line) - 1);
+		memcpy(slot->line, line, slot->length);
+		slot->line[slot->length] = '\0';
+		slot->dead = false;
+
+		RawLine raw;
+		split_line(slot->line, &raw);
+		slot->join = raw.nick && is_command(&raw, "JOIN");
+		slot->nickHash = slot->join ? nick_hash(raw.nick, raw.nickLength) : 0;
+
+		++count;
+		++live;
+		++counters.queued;
+		if (live > counters.peak)
+			counters.peak = live;
+		return true;
+	}
+
+	bool IRCInboundQueue::pop(char* line, const unsigned int size)
+	{
+		while (count)
+		{
+			Slot* slot = &slots[head];
+			head = (head + 1) % capacity;
+			--count;
+
+			if (slot->dead)
+				continue;
+
+			unsigned int length = __IRC_MIN__(slot->length, size - 1);
+			memcpy(line, slot->line, length);
+			line[length] = '\0';
+
+			--live;
+			++counters.dispatched;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool IRCInboundQueue::empty() const
+	{
+		return !live;
+	}
+
+	void IRCInboundQueue::stats(IRCInboundStats* stats) const
+	{
+		*stats = counters;
+		stats->depth = live;
+	}
+
+	void IRCInboundQueue::compact()
+	{
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			Slot* slot = &slots[(head + i) % capacity];
+			if (slot->dead)
+				continue;
+			if (kept != i)
+				slots[(head + kept) % capacity] = *slot;
+			++kept;
+		}
+		count = kept;
+	}
+
+	void IRCInboundQueue::withdraw_joins(const char* line)
+	{
+		RawLine raw;
+		split_line(line, &raw);
+
+		bool part = is_command(&raw, "PART");
+		if (!raw.nick || (!part && !is_command(&raw, "QUIT")))
+			return;
+
+		const char* channel = NULL;
+		unsigned int channelLength = part ? first_channel(raw.params, &channel) : 0;
+		unsigned int hash = nick_hash(raw.nick, raw.nickLength);
+
+		for (unsigned int i = count; i-- > 0;)
+		{
+			Slot* slot = &slots[(head + i) % capacity];
+			if (!slot->join || slot->dead || slot->nickHash != hash)
+				continue;
+
+			RawLine joined;
+			split_line(slot->line, &joined);
+			if (joined.nickLength != raw.nickLength || strncmp(joined.nick, raw.nick, raw.nickLength))
+				continue;
+
+			if (part)
+			{
+				const char* joinedChannel;
+				if (first_channel(joined.params, &joinedChannel) != channelLength || strncmp(joinedChannel, channel, channelLength))
+					continue;
+			}
+
+			// A QUIT covers every channel, a PART only the one JOIN.
+			slot->dead = true;
+			--live;
+			++counters.coalesced;
+			if (part)
+				break;
+		}
+	}
+}
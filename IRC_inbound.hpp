@@ -0,0 +1,102 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Bounded queue of received lines waiting for their callbacks.
+//
+// While callbacks fall behind, reading carries on and the queue takes up
+// the slack. Once it fills, lines are shed by priority instead of being
+// left in the socket buffer until the server drops us. By default PING is
+// answered as it is read, numerics, KICK and ERROR may use the whole queue,
+// other traffic is shed when it is nearly full and JOIN/PART/QUIT from
+// half full. A PART or QUIT that is shed also withdraws any JOIN by the
+// same nick still waiting in the queue. JOINs that were already dispatched,
+// or that are queued after the shed departure, are not affected.
+//
+// The limits apply to lines still waiting. A withdrawn JOIN keeps its slot
+// until it reaches the front or the ring fills, when the waiting lines are
+// moved up over it.
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	class IRCInboundQueue
+	{
+	public:
+		IRCInboundQueue();
+		~IRCInboundQueue();
+
+		// 0 turns the queue off. Anything queued is discarded.
+		void set_capacity(const unsigned int lines);
+		bool enabled() const;
+		// Up to 64 commands can be given their own policy.
+		void set_policy(const char* command, const IRCInboundPolicy policy);
+		IRCInboundPolicy classify(const char* line) const;
+
+		// False when the line was shed.
+		bool push(const char* line, const unsigned int length, const IRCInboundPolicy policy);
+		// Copies out the oldest line, false when there is none.
+		bool pop(char* line, const unsigned int size);
+		bool empty() const;
+		void stats(IRCInboundStats* stats) const;
+
+	private:
+		IRCInboundQueue(const IRCInboundQueue&);
+		IRCInboundQueue& operator=(const IRCInboundQueue&);
+
+		struct Rule
+		{
+			char command[16];
+			IRCInboundPolicy policy;
+		};
+
+		struct Slot
+		{
+			unsigned int length;
+			// Set on JOINs, for finding them again when shedding.
+			unsigned int nickHash;
+			bool join;
+			bool dead;
+			char line[512];
+		};
+
+		void withdraw_joins(const char* line);
+		void compact();
+
+		Rule rules[64];
+		unsigned int ruleCount;
+
+		Slot* slots;
+		unsigned int capacity;
+		unsigned int head;
+		// Slots in use, withdrawn JOINs included. live is the lines still
+		// waiting, what the limits and stats depth go by.
+		unsigned int count;
+		unsigned int live;
+
+		IRCInboundStats counters;
+	};
+}
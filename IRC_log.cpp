@@ -0,0 +1,652 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN64
+#include <fcntl.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "IRC_log.hpp"
+
+namespace cpIRC
+{
+	static const char logMagic[8] = { 'c', 'p', 'I', 'R', 'C', 'l', 'o', 'g' };
+	static const uint32_t logVersion = 1;
+	static const unsigned int logBlockRecords = 256;
+
+	struct LogSegmentHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t size;
+	};
+
+	struct LogRecordHeader
+	{
+		uint64_t timestamp;
+		uint32_t channel;
+		uint16_t length;
+		uint16_t direction;
+	};
+
+	struct IRCLogReader::IndexEntry
+	{
+		uint64_t first;
+		uint64_t last;
+		uint64_t channels;
+		uint32_t segment;
+		uint32_t offset;
+		uint32_t end;
+		uint32_t records;
+	};
+
+	// Finds the channel named by the first parameter of a raw line.
+	static unsigned int line_channel(const char* line, const unsigned int length, const char** name)
+	{
+		const char* p = line;
+		const char* end = line + length;
+
+		if (p < end && *p == ':')
+			while (p < end && *p++ != ' ');
+		while (p < end && *p != ' ')
+			++p;
+		while (p < end && *p == ' ')
+			++p;
+		if (p < end && *p == ':')
+			++p;
+
+		if (p >= end || (*p != '#' && *p != '&' && *p != '+' && *p != '!'))
+			return 0;
+
+		*name = p;
+		while (p < end && *p != ' ' && *p != ',')
+			++p;
+		return p - *name;
+	}
+
+	static uint32_t channel_hash(const char* name, const unsigned int length)
+	{
+		uint32_t hash = 2166136261u;
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			unsigned char ch = name[i];
+			if (ch >= 'A' && ch <= 'Z')
+				ch += 'a' - 'A';
+			hash = (hash ^ ch) * 16777619u;
+		}
+		return hash ? hash : 1; // Zero means "no channel".
+	}
+
+	static uint64_t channel_bloom(const uint32_t hash)
+	{
+		if (!hash)
+			return 0;
+		return (1ull << (hash & 63)) | (1ull << ((hash >> 6) & 63));
+	}
+
+	static bool read_record(const char* segment, const unsigned int end, unsigned int* offset, IRCLogRecord* record, uint32_t* channel)
+	{
+		if (*offset + sizeof(LogRecordHeader) > end)
+			return false;
+
+		LogRecordHeader header;
+		memcpy(&header, segment + *offset, sizeof(header));
+		if (!header.length || *offset + sizeof(header) + header.length > end)
+			return false;
+
+		record->timestamp = header.timestamp;
+		record->direction = header.direction;
+		record->length = header.length;
+		record->line = segment + *offset + sizeof(header);
+		*channel = header.channel;
+		*offset += (sizeof(header) + header.length + 7) & ~7u;
+		return true;
+	}
+
+#ifndef _WIN64
+
+	static void segment_path(char* dest, const unsigned int destLen, const char* directory, const unsigned int number)
+	{
+		snprintf(dest, destLen, "%s/%08u.seg", directory, number);
+	}
+
+	IRCRecorder::IRCRecorder()
+	{
+		directory[0] = '\0';
+		segmentSize = 0;
+		segmentNumber = 0;
+		segmentFile = -1;
+		indexFile = -1;
+		segment = NULL;
+		offset = 0;
+		blockOffset = 0;
+		blockRecords = 0;
+		blockFirst = 0;
+		blockLast = 0;
+		blockChannels = 0;
+	}
+
+	IRCRecorder::~IRCRecorder()
+	{
+		close();
+	}
+
+	int IRCRecorder::open(const char* directory, const unsigned int segment_size)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (segment || strlen(directory) >= sizeof(this->directory) - 16)
+			return IRC_LOG_OPEN_FAILED;
+
+		strcpy(this->directory, directory);
+		segmentSize = segment_size < 4096 ? 4096 : (segment_size + 7) & ~7u;
+		mkdir(directory, 0755);
+
+		char path[280];
+		snprintf(path, sizeof(path), "%s/index", directory);
+		indexFile = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+		if (indexFile < 0)
+			return IRC_LOG_OPEN_FAILED;
+
+		struct stat info;
+		segmentNumber = 0;
+		segment_path(path, sizeof(path), directory, segmentNumber);
+		while (!stat(path, &info))
+			segment_path(path, sizeof(path), directory, ++segmentNumber);
+
+		recover();
+
+		if (open_segment() != IRC_SUCCESS)
+		{
+			::close(indexFile);
+			indexFile = -1;
+			return IRC_LOG_OPEN_FAILED;
+		}
+
+		return IRC_SUCCESS;
+	}
+
+	int IRCRecorder::close()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (!segment)
+			return IRC_LOG_NOT_OPEN;
+
+		int result = close_segment();
+		::close(indexFile);
+		indexFile = -1;
+		return result;
+	}
+
+	int IRCRecorder::record(const int direction, const char* line, const unsigned int length)
+	{
+		if (!length)
+			return IRC_SUCCESS;
+
+		const char* name;
+		unsigned int nameLength = line_channel(line, length, &name);
+		uint32_t channel = nameLength ? channel_hash(name, nameLength) : 0;
+
+		LogRecordHeader header;
+		header.timestamp = now();
+		header.channel = channel;
+		header.length = static_cast<uint16_t>(__IRC_MIN__(length, 0xffffu));
+		header.direction = static_cast<uint16_t>(direction);
+
+		unsigned int size = (sizeof(header) + header.length + 7) & ~7u;
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (!segment)
+			return IRC_LOG_NOT_OPEN;
+
+		if (offset + size > segmentSize)
+		{
+			close_segment();
+			if (open_segment() != IRC_SUCCESS || offset + size > segmentSize)
+				return IRC_LOG_WRITE_FAILED;
+		}
+
+		// Body first, so a reader never sees a header without its line.
+		memcpy(segment + offset + sizeof(header), line, header.length);
+		memcpy(segment + offset, &header, sizeof(header));
+		offset += size;
+
+		return account(header.timestamp, channel);
+	}
+
+	unsigned long long IRCRecorder::now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		return static_cast<unsigned long long>(ts.tv_sec) * 1000000ull + ts.tv_nsec / 1000;
+	}
+
+	int IRCRecorder::open_segment()
+	{
+		char path[280];
+		segment_path(path, sizeof(path), directory, segmentNumber);
+
+		segmentFile = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (segmentFile < 0)
+			return IRC_LOG_OPEN_FAILED;
+
+		if (ftruncate(segmentFile, segmentSize))
+		{
+			::close(segmentFile);
+			return IRC_LOG_OPEN_FAILED;
+		}
+
+		void* map = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, segmentFile, 0);
+		if (map == MAP_FAILED)
+		{
+			::close(segmentFile);
+			return IRC_LOG_OPEN_FAILED;
+		}
+		segment = static_cast<char*>(map);
+
+		LogSegmentHeader header;
+		memcpy(header.magic, logMagic, sizeof(header.magic));
+		header.version = logVersion;
+		header.size = segmentSize;
+		memcpy(segment, &header, sizeof(header));
+
+		offset = sizeof(header);
+		blockOffset = offset;
+		blockRecords = 0;
+		blockChannels = 0;
+		return IRC_SUCCESS;
+	}
+
+	int IRCRecorder::close_segment()
+	{
+		int result = flush_block();
+
+		munmap(segment, segmentSize);
+		segment = NULL;
+
+		// Drop the unused tail, readers treat end of file as end of segment.
+		if (ftruncate(segmentFile, offset))
+			result = IRC_LOG_WRITE_FAILED;
+
+		::close(segmentFile);
+		segmentFile = -1;
+		++segmentNumber;
+		return result;
+	}
+
+	int IRCRecorder::account(const unsigned long long timestamp, const unsigned int channel)
+	{
+		if (!blockRecords)
+			blockFirst = timestamp;
+		blockLast = timestamp;
+		blockChannels |= channel_bloom(channel);
+
+		if (++blockRecords == logBlockRecords)
+			return flush_block();
+		return IRC_SUCCESS;
+	}
+
+	int IRCRecorder::flush_block()
+	{
+		int result = IRC_SUCCESS;
+
+		if (blockRecords)
+		{
+			IRCLogReader::IndexEntry entry;
+			entry.first = blockFirst;
+			entry.last = blockLast;
+			entry.channels = blockChannels;
+			entry.segment = segmentNumber;
+			entry.offset = blockOffset;
+			entry.end = offset;
+			entry.records = blockRecords;
+
+			if (write(indexFile, &entry, sizeof(entry)) != sizeof(entry))
+				result = IRC_LOG_WRITE_FAILED;
+		}
+
+		blockOffset = offset;
+		blockRecords = 0;
+		blockChannels = 0;
+		return result;
+	}
+
+	void IRCRecorder::recover()
+	{
+		// An unclean shutdown leaves the newest segment partly unindexed.
+		if (!segmentNumber)
+			return;
+
+		unsigned int last = segmentNumber - 1;
+		unsigned int start = sizeof(LogSegmentHeader);
+
+		IRCLogReader::IndexEntry entry;
+		off_t size = lseek(indexFile, 0, SEEK_END);
+		if (size >= static_cast<off_t>(sizeof(entry)) &&
+			pread(indexFile, &entry, sizeof(entry), size - size % sizeof(entry) - sizeof(entry)) == sizeof(entry))
+		{
+			if (entry.segment > last)
+				return;
+			if (entry.segment == last)
+				start = entry.end;
+		}
+
+		char path[280];
+		segment_path(path, sizeof(path), directory, last);
+		int file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat info;
+		if (fstat(file, &info) || info.st_size <= start)
+		{
+			::close(file);
+			return;
+		}
+
+		unsigned int length = static_cast<unsigned int>(info.st_size);
+		void* map = mmap(NULL, length, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		if (map == MAP_FAILED)
+			return;
+
+		unsigned int saved = segmentNumber;
+		segmentNumber = last;
+		offset = start;
+		blockOffset = start;
+		blockRecords = 0;
+		blockChannels = 0;
+
+		IRCLogRecord record;
+		uint32_t channel;
+		while (read_record(static_cast<const char*>(map), length, &offset, &record, &channel))
+			account(record.timestamp, channel);
+		flush_block();
+
+		munmap(map, length);
+		segmentNumber = saved;
+	}
+
+	IRCLogReader::IRCLogReader()
+	{
+		directory[0] = '\0';
+		channel[0] = '\0';
+		channelHash = 0;
+		from = 0;
+		to = 0;
+		entries = NULL;
+		entryCount = 0;
+		entry = 0;
+		tail = false;
+		segmentNumber = 0;
+		segment = NULL;
+		segmentLength = 0;
+		offset = 0;
+		end = 0;
+	}
+
+	IRCLogReader::~IRCLogReader()
+	{
+		close();
+	}
+
+	int IRCLogReader::open(const char* directory, unsigned long long from, unsigned long long to, const char* channel)
+	{
+		close();
+
+		if (strlen(directory) >= sizeof(this->directory) - 16 || (channel && strlen(channel) >= sizeof(this->channel)))
+			return IRC_LOG_OPEN_FAILED;
+
+		strcpy(this->directory, directory);
+		this->from = from;
+		this->to = to;
+		if (channel)
+		{
+			strcpy(this->channel, channel);
+			channelHash = channel_hash(channel, strlen(channel));
+		}
+
+		char path[280];
+		snprintf(path, sizeof(path), "%s/index", directory);
+		int file = ::open(path, O_RDONLY);
+		if (file >= 0)
+		{
+			struct stat info;
+			if (!fstat(file, &info) && info.st_size >= static_cast<off_t>(sizeof(IndexEntry)))
+			{
+				entryCount = static_cast<unsigned int>(info.st_size / sizeof(IndexEntry));
+				entries = irc_new_array<IndexEntry>(entryCount);
+				if (read(file, entries, entryCount * sizeof(IndexEntry)) != static_cast<ssize_t>(entryCount * sizeof(IndexEntry)))
+				{
+					irc_delete_array(entries, entryCount);
+					entries = NULL;
+					entryCount = 0;
+				}
+			}
+			::close(file);
+		}
+
+		if (!entryCount && !map_segment(0))
+			return IRC_LOG_OPEN_FAILED;
+
+		return IRC_SUCCESS;
+	}
+
+	bool IRCLogReader::next(IRCLogRecord* record)
+	{
+		while (1)
+		{
+			if (!segment || offset >= end)
+			{
+				if (!next_block())
+					return false;
+				continue;
+			}
+
+			uint32_t hash;
+			if (!read_record(segment, end, &offset, record, &hash))
+			{
+				offset = end;
+				continue;
+			}
+
+			if (record->timestamp < from || (to && record->timestamp > to))
+				continue;
+
+			if (channelHash)
+			{
+				const char* name;
+				unsigned int length = hash == channelHash ? line_channel(record->line, record->length, &name) : 0;
+				if (length != strlen(channel) || strncasecmp(name, channel, length))
+					continue;
+			}
+
+			return true;
+		}
+	}
+
+	void IRCLogReader::close()
+	{
+		unmap_segment();
+		irc_delete_array(entries, entryCount);
+		entries = NULL;
+		entryCount = 0;
+		entry = 0;
+		tail = false;
+		channel[0] = '\0';
+		channelHash = 0;
+	}
+
+	bool IRCLogReader::map_segment(unsigned int number)
+	{
+		if (segment && segmentNumber == number)
+			return true;
+
+		unmap_segment();
+
+		char path[280];
+		segment_path(path, sizeof(path), directory, number);
+		int file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(file, &info) || info.st_size < static_cast<off_t>(sizeof(LogSegmentHeader)))
+		{
+			::close(file);
+			return false;
+		}
+
+		void* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		if (map == MAP_FAILED)
+			return false;
+
+		if (memcmp(map, logMagic, sizeof(logMagic)))
+		{
+			munmap(map, info.st_size);
+			return false;
+		}
+
+		segment = static_cast<char*>(map);
+		segmentLength = static_cast<unsigned int>(info.st_size);
+		segmentNumber = number;
+		return true;
+	}
+
+	void IRCLogReader::unmap_segment()
+	{
+		if (segment)
+			munmap(segment, segmentLength);
+		segment = NULL;
+		segmentLength = 0;
+		offset = 0;
+		end = 0;
+	}
+
+	bool IRCLogReader::next_block()
+	{
+		while (!tail && entry < entryCount)
+		{
+			const IndexEntry* e = &entries[entry++];
+			if (e->last < from || (to && e->first > to))
+				continue;
+			if (channelHash && !(e->channels & channel_bloom(channelHash)))
+				continue;
+			if (!map_segment(e->segment) || e->end > segmentLength)
+				continue;
+
+			offset = e->offset;
+			end = e->end;
+			return true;
+		}
+
+		// Records written after the last index entry.
+		unsigned int number = segmentNumber + 1;
+		unsigned int start = sizeof(LogSegmentHeader);
+		if (!tail)
+		{
+			tail = true;
+			number = 0;
+			if (entryCount)
+			{
+				number = entries[entryCount - 1].segment;
+				start = entries[entryCount - 1].end;
+			}
+		}
+
+		if (!map_segment(number))
+			return false;
+
+		offset = start;
+		end = segmentLength;
+		return true;
+	}
+
+#else
+
+	IRCRecorder::IRCRecorder() : segment(NULL)
+	{
+	}
+
+	IRCRecorder::~IRCRecorder()
+	{
+	}
+
+	int IRCRecorder::open(const char*, const unsigned int)
+	{
+		return IRC_LOG_OPEN_FAILED;
+	}
+
+	int IRCRecorder::close()
+	{
+		return IRC_LOG_NOT_OPEN;
+	}
+
+	int IRCRecorder::record(const int, const char*, const unsigned int)
+	{
+		return IRC_LOG_NOT_OPEN;
+	}
+
+	unsigned long long IRCRecorder::now()
+	{
+		FILETIME ft;
+		GetSystemTimeAsFileTime(&ft);
+		unsigned long long ticks = (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+		return ticks / 10 - 11644473600000000ull;
+	}
+
+	IRCLogReader::IRCLogReader() : entries(NULL), segment(NULL)
+	{
+	}
+
+	IRCLogReader::~IRCLogReader()
+	{
+	}
+
+	int IRCLogReader::open(const char*, unsigned long long, unsigned long long, const char*)
+	{
+		return IRC_LOG_OPEN_FAILED;
+	}
+
+	bool IRCLogReader::next(IRCLogRecord*)
+	{
+		return false;
+	}
+
+	void IRCLogReader::close()
+	{
+	}
+
+#endif
+}
@@ -0,0 +1,134 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Binary traffic log.
+//
+// Raw lines are appended to fixed-size, memory-mapped segment files
+// (<directory>/<number>.seg) as timestamped records. Every block of records
+// gets an entry in <directory>/index holding its time range, position and a
+// 64-bit channel bloom mask, so readers can skip straight to what they need.
+// Timestamps are microseconds since the Unix epoch.
+
+#include <mutex>
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	enum IRCLogDirection
+	{
+		IRC_LOG_IN = 0,
+		IRC_LOG_OUT
+	};
+
+	struct IRCLogRecord
+	{
+		unsigned long long timestamp;
+		int direction;
+		unsigned int length;
+		const char* line; // Not null-terminated.
+	};
+
+	class IRCRecorder
+	{
+	public:
+		IRCRecorder();
+		~IRCRecorder();
+
+		int open(const char* directory, const unsigned int segment_size);
+		int close();
+		int record(const int direction, const char* line, const unsigned int length);
+
+		static unsigned long long now();
+
+	private:
+		IRCRecorder(const IRCRecorder&);
+		IRCRecorder& operator=(const IRCRecorder&);
+
+		int open_segment();
+		int close_segment();
+		int account(const unsigned long long timestamp, const unsigned int channel);
+		int flush_block();
+		void recover();
+
+		std::mutex lock;
+		char directory[256];
+		unsigned int segmentSize;
+		unsigned int segmentNumber;
+		int segmentFile;
+		int indexFile;
+		char* segment;
+		unsigned int offset;
+
+		// Current index block.
+		unsigned int blockOffset;
+		unsigned int blockRecords;
+		unsigned long long blockFirst;
+		unsigned long long blockLast;
+		unsigned long long blockChannels;
+	};
+
+	class IRCLogReader
+	{
+	public:
+		IRCLogReader();
+		~IRCLogReader();
+
+		// to == 0 means no upper bound, channel == NULL means every line.
+		int open(const char* directory, unsigned long long from, unsigned long long to, const char* channel);
+		bool next(IRCLogRecord* record);
+		void close();
+
+	private:
+		friend class IRCRecorder;
+
+		IRCLogReader(const IRCLogReader&);
+		IRCLogReader& operator=(const IRCLogReader&);
+
+		struct IndexEntry;
+
+		bool map_segment(unsigned int number);
+		void unmap_segment();
+		bool next_block();
+
+		char directory[256];
+		char channel[64];
+		unsigned int channelHash;
+		unsigned long long from;
+		unsigned long long to;
+
+		IndexEntry* entries;
+		unsigned int entryCount;
+		unsigned int entry;
+		bool tail;
+
+		unsigned int segmentNumber;
+		char* segment;
+		unsigned int segmentLength;
+		unsigned int offset;
+		unsigned int end;
+	};
+}
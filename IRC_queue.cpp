@@ -0,0 +1,114 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include "IRC_queue.hpp"
+
+namespace cpIRC
+{
+	IRCSendQueue::IRCSendQueue(unsigned int capacity)
+	{
+		unsigned int size = 2;
+		while (size < capacity)
+			size <<= 1;
+
+		slots = irc_new_array<Slot>(size);
+		for (unsigned int i = 0; i < size; ++i)
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+
+		mask = size - 1;
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+		consuming.store(false, std::memory_order_release);
+	}
+
+	IRCSendQueue::~IRCSendQueue()
+	{
+		irc_delete_array(slots, mask + 1);
+	}
+
+	bool IRCSendQueue::push(const char* line, const unsigned int length)
+	{
+		unsigned int pos = head.load(std::memory_order_relaxed);
+		Slot* slot;
+
+		while (1)
+		{
+			slot = &slots[pos & mask];
+			int diff = static_cast<int>(slot->sequence.load(std::memory_order_acquire) - pos);
+
+			if (!diff)
+			{
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0) // Full.
+				return false;
+			else
+				pos = head.load(std::memory_order_relaxed);
+		}
+
+		slot->length = __IRC_MIN__(length, sizeof(slot->line));
+		memcpy(slot->line, line, slot->length);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool IRCSendQueue::pop(char* line, unsigned int* length)
+	{
+		unsigned int pos = tail.load(std::memory_order_relaxed);
+		Slot* slot = &slots[pos & mask];
+
+		if (slot->sequence.load(std::memory_order_acquire) != pos + 1)
+			return false;
+
+		*length = slot->length;
+		memcpy(line, slot->line, slot->length);
+		slot->sequence.store(pos + mask + 1, std::memory_order_release);
+		tail.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool IRCSendQueue::empty() const
+	{
+		unsigned int pos = tail.load(std::memory_order_relaxed);
+		return slots[pos & mask].sequence.load(std::memory_order_seq_cst) != pos + 1;
+	}
+
+	// The handoff is a store then a load on each side: a producer pushes and
+	// then tries for the role, the holder gives it up and then checks
+	// empty(). Without full fences either side may read a stale value and
+	// both walk away from a queued line.
+	bool IRCSendQueue::acquire_consumer()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return !consuming.exchange(true, std::memory_order_seq_cst);
+	}
+
+	void IRCSendQueue::release_consumer()
+	{
+		consuming.store(false, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
@@ -0,0 +1,70 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Bounded multi-producer queue of preformatted outgoing lines.
+//
+// Any thread may push(). Only the thread holding the consumer role, taken
+// with acquire_consumer(), may pop(). The ring follows Dmitry Vyukov's
+// bounded queue: every slot carries a sequence number, so producers claim
+// slots with a single compare-and-swap and never wait on each other.
+
+#include <atomic>
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	class IRCSendQueue
+	{
+	public:
+		explicit IRCSendQueue(unsigned int capacity);
+		~IRCSendQueue();
+
+		bool push(const char* line, const unsigned int length);
+		bool pop(char* line, unsigned int* length);
+		bool empty() const;
+
+		bool acquire_consumer();
+		void release_consumer();
+
+	private:
+		IRCSendQueue(const IRCSendQueue&);
+		IRCSendQueue& operator=(const IRCSendQueue&);
+
+		struct Slot
+		{
+			std::atomic<unsigned int> sequence;
+			unsigned int length;
+			char line[512];
+		};
+
+		Slot* slots;
+		unsigned int mask;
+		std::atomic<unsigned int> head;
+		std::atomic<unsigned int> tail;
+		std::atomic<bool> consuming;
+	};
+}
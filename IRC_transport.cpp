@@ -0,0 +1,250 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#include "IRC_transport.hpp"
+
+#ifndef _WIN64
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace cpIRC
+{
+	IRCSocketTransport::IRCSocketTransport()
+	{
+		sock = INVALID_SOCKET;
+	}
+
+	IRCSocketTransport::~IRCSocketTransport()
+	{
+		if (sock != INVALID_SOCKET)
+			closesocket(sock);
+	}
+
+	int IRCSocketTransport::connect_tcp(const char* server, const short int port)
+	{
+		hostent* resolve;
+		sockaddr_in rem;
+
+		if (sock != INVALID_SOCKET)
+			return IRC_ALREADY_CONNECTED;
+
+		sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (sock == INVALID_SOCKET)
+			return IRC_SOCKET_CREATION_FAILED;
+
+		resolve = gethostbyname(server);
+		if (!resolve)
+		{
+			closesocket(sock);
+			sock = INVALID_SOCKET;
+			return IRC_RESOLVE_FAILED;
+		}
+
+		memset(&rem, 0, sizeof(rem));
+		memcpy(&rem.sin_addr, resolve->h_addr, 4);
+		rem.sin_family = AF_INET;
+		rem.sin_port = htons(port);
+
+		if (::connect(sock, reinterpret_cast<const sockaddr*>(&rem), sizeof(rem)) == SOCKET_ERROR)
+		{
+			closesocket(sock);
+			sock = INVALID_SOCKET;
+			return IRC_SOCKET_CONNECT_FAILED;
+		}
+
+		return IRC_SUCCESS;
+	}
+
+	int IRCSocketTransport::connect_unix(const char* path)
+	{
+#ifndef _WIN64
+		sockaddr_un rem;
+
+		if (sock != INVALID_SOCKET)
+			return IRC_ALREADY_CONNECTED;
+
+		if (strlen(path) >= sizeof(rem.sun_path))
+			return IRC_RESOLVE_FAILED;
+
+		sock = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (sock == INVALID_SOCKET)
+			return IRC_SOCKET_CREATION_FAILED;
+
+		memset(&rem, 0, sizeof(rem));
+		rem.sun_family = AF_UNIX;
+		strcpy(rem.sun_path, path);
+
+		if (::connect(sock, reinterpret_cast<const sockaddr*>(&rem), sizeof(rem)) == SOCKET_ERROR)
+		{
+			closesocket(sock);
+			sock = INVALID_SOCKET;
+			return IRC_SOCKET_CONNECT_FAILED;
+		}
+
+		return IRC_SUCCESS;
+#else
+		return IRC_SOCKET_CREATION_FAILED;
+#endif
+	}
+
+	int IRCSocketTransport::attach(const int socket)
+	{
+		if (sock != INVALID_SOCKET)
+			return IRC_ALREADY_CONNECTED;
+
+		sock = socket;
+		return IRC_SUCCESS;
+	}
+
+	int IRCSocketTransport::pair(IRCSocketTransport* first, IRCSocketTransport* second)
+	{
+#ifndef _WIN64
+		int sockets[2];
+
+		if (first->sock != INVALID_SOCKET || second->sock != INVALID_SOCKET)
+			return IRC_ALREADY_CONNECTED;
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets))
+			return IRC_SOCKET_CREATION_FAILED;
+
+		first->sock = sockets[0];
+		second->sock = sockets[1];
+		return IRC_SUCCESS;
+#else
+		return IRC_SOCKET_CREATION_FAILED;
+#endif
+	}
+
+	int IRCSocketTransport::send(const char* data, const unsigned int length)
+	{
+		unsigned int sent = 0;
+
+		while (sent < length)
+		{
+			int result = ::send(sock, data + sent, length - sent, MSG_NOSIGNAL);
+			if (result == SOCKET_ERROR || !result)
+				return IRC_SEND_FAILED;
+			sent += result;
+		}
+
+		return IRC_SUCCESS;
+	}
+
+	int IRCSocketTransport::recv(char* buffer, const unsigned int length)
+	{
+		return ::recv(sock, buffer, length, 0);
+	}
+
+	int IRCSocketTransport::close()
+	{
+		if (sock == INVALID_SOCKET)
+			return IRC_NOT_CONNECTED;
+
+		// shutdown() fails once the peer has hung up, which is no reason to
+		// keep the descriptor.
+		shutdown(sock, 2);
+
+		int result = closesocket(sock) ? IRC_SOCKET_CLOSE_FAILED : IRC_SUCCESS;
+		sock = INVALID_SOCKET;
+		return result;
+	}
+
+	int IRCSocketTransport::descriptor() const
+	{
+		return sock;
+	}
+
+	IRCMemoryTransport::IRCMemoryTransport()
+	{
+		inputOffset = 0;
+		capture = true;
+	}
+
+	IRCMemoryTransport::~IRCMemoryTransport()
+	{
+	}
+
+	void IRCMemoryTransport::feed(const char* data, const unsigned int length)
+	{
+		if (inputOffset == input.size())
+		{
+			input.clear();
+			inputOffset = 0;
+		}
+
+		input.insert(input.end(), data, data + length);
+	}
+
+	void IRCMemoryTransport::set_capture(const bool capture)
+	{
+		this->capture = capture;
+	}
+
+	const char* IRCMemoryTransport::output() const
+	{
+		return sent.empty() ? "" : &sent[0];
+	}
+
+	unsigned int IRCMemoryTransport::output_length() const
+	{
+		return sent.size();
+	}
+
+	void IRCMemoryTransport::clear_output()
+	{
+		sent.clear();
+	}
+
+	int IRCMemoryTransport::send(const char* data, const unsigned int length)
+	{
+		if (capture)
+			sent.insert(sent.end(), data, data + length);
+		return IRC_SUCCESS;
+	}
+
+	int IRCMemoryTransport::recv(char* buffer, const unsigned int length)
+	{
+		unsigned int count = __IRC_MIN__(length, input.size() - inputOffset);
+		if (!count)
+			return 0;
+
+		memcpy(buffer, &input[0] + inputOffset, count);
+		inputOffset += count;
+		return count;
+	}
+
+	int IRCMemoryTransport::close()
+	{
+		input.clear();
+		inputOffset = 0;
+		return IRC_SUCCESS;
+	}
+}
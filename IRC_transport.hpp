@@ -0,0 +1,101 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+#pragma once
+// Byte transports for the IRC class.
+//
+// IRC only ever talks to an IRCTransport, so the parser and dispatcher run
+// the same way over a TCP connection, a UNIX socket, one end of a
+// socketpair or an in-memory buffer. Anything else (TLS, say) plugs in by
+// implementing the four calls below.
+
+#include <vector>
+
+#include "IRC.hpp"
+
+namespace cpIRC
+{
+	class IRCTransport
+	{
+	public:
+		virtual ~IRCTransport() {}
+
+		// IRC_SUCCESS once every byte is written, IRC_SEND_FAILED otherwise.
+		virtual int send(const char* data, const unsigned int length) = 0;
+		// Bytes read, 0 when the peer has closed, SOCKET_ERROR on failure.
+		virtual int recv(char* buffer, const unsigned int length) = 0;
+		virtual int close() = 0;
+		// Pollable descriptor, or -1 when there is none.
+		virtual int descriptor() const { return -1; }
+	};
+
+	class IRCSocketTransport : public IRCTransport
+	{
+	public:
+		IRCSocketTransport();
+		~IRCSocketTransport();
+
+		int connect_tcp(const char* server, const short int port);
+		int connect_unix(const char* path);
+		int attach(const int socket);
+		static int pair(IRCSocketTransport* first, IRCSocketTransport* second);
+
+		int send(const char* data, const unsigned int length);
+		int recv(char* buffer, const unsigned int length);
+		int close();
+		int descriptor() const;
+
+	private:
+		IRCSocketTransport(const IRCSocketTransport&);
+		IRCSocketTransport& operator=(const IRCSocketTransport&);
+
+		int sock;
+	};
+
+	class IRCMemoryTransport : public IRCTransport
+	{
+	public:
+		IRCMemoryTransport();
+		~IRCMemoryTransport();
+
+		// Queues data for recv(), which reports a closed peer once it runs dry.
+		void feed(const char* data, const unsigned int length);
+		// Sent data is kept for inspection unless capturing is turned off.
+		void set_capture(const bool capture);
+		const char* output() const;
+		unsigned int output_length() const;
+		void clear_output();
+
+		int send(const char* data, const unsigned int length);
+		int recv(char* buffer, const unsigned int length);
+		int close();
+
+	private:
+		std::vector<char, IRCStdAllocator<char> > input;
+		unsigned int inputOffset;
+		std::vector<char, IRCStdAllocator<char> > sent;
+		bool capture;
+	};
+}
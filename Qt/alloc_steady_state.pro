@@ -0,0 +1,34 @@
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+QMAKE_CXXFLAGS += -std=c++0x -pthread
+LIBS += -pthread
+
+SOURCES += \
+    ../tests/alloc_steady_state.cpp \
+    ../IRC.cpp \
+    ../IRC_filter.cpp \
+    ../IRC_log.cpp \
+    ../IRC_transport.cpp \
+    ../IRC_queue.cpp \
+    ../IRC_bouncer.cpp \
+    ../IRC_alloc.cpp \
+    ../IRC_ctcp.cpp \
+    ../IRC_dcc.cpp \
+    ../IRC_inbound.cpp
+
+HEADERS += \
+    ../IRC.hpp \
+    ../IRC_errors.hpp \
+    ../IRC_responses.hpp \
+    ../IRC_filter.hpp \
+    ../IRC_log.hpp \
+    ../IRC_transport.hpp \
+    ../IRC_queue.hpp \
+    ../IRC_bouncer.hpp \
+    ../IRC_delegate.hpp \
+    ../IRC_alloc.hpp \
+    ../IRC_ctcp.hpp \
+    ../IRC_dcc.hpp \
+    ../IRC_inbound.hpp
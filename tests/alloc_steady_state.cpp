@@ -0,0 +1,144 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+// Checks that a warmed-up connection allocates nothing per message.
+//
+// Feeds PRIVMSGs (some caught by the filter), CTCP requests and PINGs
+// through a memory transport, with callbacks that reply to every message.
+// Both the library's allocator hooks and the global operator new are
+// counted. Exits non-zero if either sees an allocation in steady state, or
+// if teardown doesn't hand back everything that went through the hooks.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "../IRC.hpp"
+#include "../IRC_filter.hpp"
+#include "../IRC_transport.hpp"
+
+using namespace cpIRC;
+
+static unsigned long long globalNews = 0;
+
+void* operator new(size_t size)
+{
+	++globalNews;
+	void* pointer = malloc(size ? size : 1);
+	if (!pointer)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+static const char* lines[] =
+{
+	":a!b@c PRIVMSG #c :hello world\r\n",
+	":a!b@c PRIVMSG #c :buy spam now\r\n",
+	":x!y@evil.example PRIVMSG #c :hi\r\n",
+	":a!b@c PRIVMSG me :\x01VERSION\x01\r\n",
+	":a!b@c PRIVMSG me :\x01PING 12345\x01\r\n",
+	":a!b@c PRIVMSG #c :\x01" "ACTION waves\x01\r\n",
+	"PING :irc.example.org\r\n",
+	":irc.example.org 001 me :Welcome\r\n"
+};
+
+static char batch[65536];
+static unsigned int batchLength = 0;
+
+static void feed(IRC* irc, IRCMemoryTransport* transport, int rounds)
+{
+	for (int i = 0; i < rounds; ++i)
+	{
+		transport->feed(batch, batchLength);
+		irc->message_loop();
+	}
+}
+
+int main()
+{
+	IRCAllocationCounter counter;
+	IRCAllocator allocator = counter.allocator();
+	set_allocator(&allocator);
+
+	int seen = 0;
+	int filtered = 0;
+	int result = 0;
+
+	{
+		IRCMemoryTransport transport;
+		transport.set_capture(false);
+
+		IRC irc(NULL);
+		irc.set_ctcp_limits(0, 1000000, 0);
+
+		IRCFilter filter;
+		IRCFilterSet* set = irc_new<IRCFilterSet>();
+		set->add_keyword("spam", 1);
+		set->add_mask("*!*@evil.example", 2);
+		filter.publish(set);
+
+		irc.set_filter(&filter, [&filtered](IRC*, IRCReply*, int) { ++filtered; return 1; });
+		irc.set_callback("PRIVMSG", [&seen](IRC* irc, IRCReply* reply) { ++seen; irc->privmsg("#c", reply->params); return 0; });
+		irc.set_callback("001", [&seen](IRC* irc, IRCReply*) { ++seen; irc->join("#c"); return 0; });
+		irc.connect(&transport);
+
+		for (unsigned int i = 0; batchLength + 512 < sizeof(batch); i = (i + 1) % (sizeof(lines) / sizeof(lines[0])))
+		{
+			unsigned int length = strlen(lines[i]);
+			memcpy(batch + batchLength, lines[i], length);
+			batchLength += length;
+		}
+
+		// Warm up, then measure.
+		feed(&irc, &transport, 10);
+		unsigned long long news = globalNews;
+		unsigned long long allocations = counter.allocations();
+		feed(&irc, &transport, 100);
+		news = globalNews - news;
+		allocations = counter.allocations() - allocations;
+
+		printf("steady state: %llu hook allocations, %llu operator new calls (%d messages handled, %d filtered)\n", allocations, news, seen, filtered);
+		if (allocations || news || !seen || !filtered)
+			result = 1;
+	}
+
+	set_allocator(NULL);
+
+	printf("after teardown: %llu allocations, %llu deallocations\n", counter.allocations(), counter.deallocations());
+	if (counter.allocations() != counter.deallocations())
+		result = 1;
+	return result;
+}
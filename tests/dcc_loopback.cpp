@@ -0,0 +1,315 @@
+/*
+	cpIRC - C++ class based IRC protocol wrapper
+	Copyright (C) 2003 Iain Sheppard
+
+	This library is free software; you can redistribute it and/or
+	modify it under the terms of the GNU Lesser General Public
+	License as published by the Free Software Foundation; either
+	version 2.1 of the License, or (at your option) any later version.
+
+	This library is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+	Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+	Contacting the author:
+	~~~~~~~~~~~~~~~~~~~~~~
+
+	email:	iainsheppard@yahoo.co.uk
+	IRC:	#magpie @ irc.quakenet.org
+*/
+
+// Runs DCC SEND between two IRC connections over loopback.
+//
+// A small relay stands in for the server, passing PRIVMSG and NOTICE
+// between the two connections with a nick prefix added. Covers a plain
+// transfer, a transfer continued from a partial file with RESUME/ACCEPT,
+// and a sender that hangs up partway through. Exits non-zero if any of
+// them ends differently. On Windows, where DCC is stubbed out, it just
+// reports that it was skipped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN64
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../IRC.hpp"
+#include "../IRC_dcc.hpp"
+#include "../IRC_transport.hpp"
+
+using namespace cpIRC;
+
+#ifndef _WIN64
+
+// One direction through the fake server.
+struct Relay
+{
+	int from;
+	int to;
+	const char* prefix;
+	char buffer[4096];
+	unsigned int length;
+};
+
+// Last thing a side's callback heard about.
+struct Outcome
+{
+	unsigned int id;
+	IRCDccState state;
+	unsigned long long size;
+	unsigned long long position;
+	unsigned long long offset;
+	bool finished;
+};
+
+static void relay(Relay* relay)
+{
+	int length;
+	while ((length = recv(relay->from, relay->buffer + relay->length, sizeof(relay->buffer) - relay->length, MSG_DONTWAIT)) > 0)
+	{
+		relay->length += length;
+
+		char* line = relay->buffer;
+		char* end;
+		while ((end = static_cast<char*>(memchr(line, '\n', relay->buffer + relay->length - line))))
+		{
+			if (!strncmp(line, "PRIVMSG ", 8) || !strncmp(line, "NOTICE ", 7))
+			{
+				send(relay->to, relay->prefix, strlen(relay->prefix), MSG_NOSIGNAL);
+				send(relay->to, line, end + 1 - line, MSG_NOSIGNAL);
+			}
+			line = end + 1;
+		}
+
+		relay->length -= line - relay->buffer;
+		memmove(relay->buffer, line, relay->length);
+	}
+}
+
+static bool write_file(const char* path, unsigned long long size, unsigned int seed)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	unsigned int value = seed;
+	for (unsigned long long i = 0; i < size; ++i)
+	{
+		value = value * 1103515245u + 12345u;
+		fputc(value >> 16, file);
+	}
+	return !fclose(file);
+}
+
+static bool same_files(const char* first, const char* second)
+{
+	FILE* a = fopen(first, "rb");
+	FILE* b = fopen(second, "rb");
+	bool same = a && b;
+
+	while (same)
+	{
+		int ch = fgetc(a);
+		same = ch == fgetc(b);
+		if (ch == EOF)
+			break;
+	}
+
+	if (a)
+		fclose(a);
+	if (b)
+		fclose(b);
+	return same;
+}
+
+class Loopback
+{
+public:
+	Loopback() : alice(NULL), bob(NULL), sender(&alice, NULL), receiver(&bob, NULL)
+	{
+		int a[2];
+		int b[2];
+		socketpair(AF_UNIX, SOCK_STREAM, 0, a);
+		socketpair(AF_UNIX, SOCK_STREAM, 0, b);
+
+		aliceTransport.attach(a[0]);
+		bobTransport.attach(b[0]);
+		alice.connect(&aliceTransport);
+		bob.connect(&bobTransport);
+
+		// Alice's lines reach Bob as coming from alice and the other way round.
+		toBob.from = a[1];
+		toBob.to = b[1];
+		toBob.prefix = ":alice!a@localhost ";
+		toBob.length = 0;
+		toAlice.from = b[1];
+		toAlice.to = a[1];
+		toAlice.prefix = ":bob!b@localhost ";
+		toAlice.length = 0;
+
+		// Offers arrive back to back, faster than the CTCP limits allow.
+		bob.set_ctcp_limits(0, 100, 0);
+
+		memset(&sent, 0, sizeof(sent));
+		memset(&received, 0, sizeof(received));
+
+		sender.set_callback([this](IRCDcc*, const IRCDccStats* stats) { record(&sent, stats); return 0; });
+		receiver.set_callback([this](IRCDcc* dcc, const IRCDccStats* stats)
+		{
+			if (stats->state == IRC_DCC_OFFERED)
+			{
+				received.id = stats->id;
+				dcc->accept(stats->id);
+			}
+			else
+				record(&received, stats);
+			return 0;
+		});
+	}
+
+	~Loopback()
+	{
+		alice.disconnect();
+		bob.disconnect();
+		closesocket(toBob.from);
+		closesocket(toAlice.from);
+	}
+
+	void set_directory(const char* path)
+	{
+		receiver.set_directory(path);
+	}
+
+	// Sends path to bob, hanging up once hangUpAt bytes have arrived if that's non-zero.
+	bool transfer(const char* path, unsigned long long hangUpAt)
+	{
+		memset(&sent, 0, sizeof(sent));
+		memset(&received, 0, sizeof(received));
+
+		unsigned int id;
+		if (sender.send_file("bob", path, &id) != IRC_SUCCESS)
+			return false;
+
+		time_t deadline = time(NULL) + 30;
+		while (!(sent.finished && received.finished) && time(NULL) < deadline)
+		{
+			sender.step(5);
+			relay(&toBob);
+			relay(&toAlice);
+			receiver.step(5);
+
+			IRCDccStats stats;
+			if (hangUpAt && !sent.finished && receiver.stats(received.id, &stats) == IRC_SUCCESS && stats.position >= hangUpAt)
+				sender.cancel(id);
+		}
+
+		return sent.finished && received.finished;
+	}
+
+	Outcome sent;
+	Outcome received;
+
+private:
+	void record(Outcome* outcome, const IRCDccStats* stats)
+	{
+		outcome->id = stats->id;
+		outcome->state = stats->state;
+		outcome->size = stats->size;
+		outcome->position = stats->position;
+		outcome->offset = stats->offset;
+		outcome->finished = stats->state == IRC_DCC_DONE || stats->state == IRC_DCC_FAILED;
+	}
+
+	IRCSocketTransport aliceTransport;
+	IRCSocketTransport bobTransport;
+	IRC alice;
+	IRC bob;
+	IRCDcc sender;
+	IRCDcc receiver;
+	Relay toBob;
+	Relay toAlice;
+};
+
+static int check(const char* name, bool passed)
+{
+	printf("%s: %s\n", name, passed ? "ok" : "FAILED");
+	return passed ? 0 : 1;
+}
+
+int main()
+{
+	char base[] = "/tmp/cpirc-dcc-XXXXXX";
+	if (!mkdtemp(base))
+		return 1;
+
+	char outgoing[64];
+	char incoming[64];
+	char source[128];
+	char target[128];
+	snprintf(outgoing, sizeof(outgoing), "%s/out", base);
+	snprintf(incoming, sizeof(incoming), "%s/in", base);
+	if (mkdir(outgoing, 0700) || mkdir(incoming, 0700))
+		return 1;
+
+	int result = 0;
+
+	{
+		Loopback loopback;
+		loopback.set_directory(incoming);
+
+		snprintf(source, sizeof(source), "%s/plain.bin", outgoing);
+		snprintf(target, sizeof(target), "%s/plain.bin", incoming);
+		write_file(source, 3000000, 1);
+		bool finished = loopback.transfer(source, 0);
+		result |= check("plain send", finished && loopback.sent.state == IRC_DCC_DONE && loopback.received.state == IRC_DCC_DONE &&
+			!loopback.received.offset && same_files(source, target));
+		unlink(source);
+		unlink(target);
+
+		// The first part is already on disk, only the rest should be sent.
+		snprintf(source, sizeof(source), "%s/resume.bin", outgoing);
+		snprintf(target, sizeof(target), "%s/resume.bin", incoming);
+		write_file(source, 5000000, 2);
+		write_file(target, 2000000, 2);
+		finished = loopback.transfer(source, 0);
+		result |= check("resume", finished && loopback.sent.state == IRC_DCC_DONE && loopback.received.state == IRC_DCC_DONE &&
+			loopback.received.offset == 2000000 && loopback.sent.offset == 2000000 && same_files(source, target));
+		unlink(source);
+		unlink(target);
+
+		// Big enough that the sender can't get it all out before hanging up.
+		snprintf(source, sizeof(source), "%s/hangup.bin", outgoing);
+		snprintf(target, sizeof(target), "%s/hangup.bin", incoming);
+		write_file(source, 32000000, 3);
+		finished = loopback.transfer(source, 1000000);
+		result |= check("sender hang-up", finished && loopback.sent.state == IRC_DCC_FAILED && loopback.received.state == IRC_DCC_FAILED &&
+			loopback.received.position < loopback.received.size);
+		unlink(source);
+		unlink(target);
+	}
+
+	rmdir(outgoing);
+	rmdir(incoming);
+	rmdir(base);
+	return result;
+}
+
+#else
+
+int main()
+{
+	printf("skipped, DCC is POSIX only\n");
+	return 0;
+}
+
+#endif